@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <string.h>
+
+extern "C"
+{
+#include "libavutil/mem.h"
+}
+
+// Single-producer/single-consumer ring of interleaved float samples.
+// The decoder writes decoded audio, the BASS stream callback reads it.
+// Positions and counts are in frames (one sample per channel), so only whole frames are ever moved.
+class AudioQueue
+{
+private:
+	float* samples = nullptr;
+	unsigned int capacity = 0; // Frames, power of two
+	unsigned int channels = 0;
+
+	std::atomic<unsigned int> head{ 0 }; // Written by the producer only
+	std::atomic<unsigned int> tail{ 0 }; // Written by the consumer only
+	std::atomic<unsigned int> discard{ 0 }; // Frames before this are skipped by the consumer
+
+	// First frame the consumer has not read or skipped yet
+	unsigned int ReadIndex() const
+	{
+		unsigned int index = tail.load(std::memory_order_acquire);
+		unsigned int skip = discard.load(std::memory_order_acquire);
+		return (int)(skip - index) > 0 ? skip : index;
+	}
+
+public:
+	bool Allocate(unsigned int frames, unsigned int channel_count)
+	{
+		Free();
+
+		capacity = 1;
+		while (capacity < frames)
+		{
+			capacity <<= 1;
+		}
+
+		samples = (float*)av_malloc_array(capacity, channel_count * sizeof(float));
+		if (!samples)
+		{
+			capacity = 0;
+			return false;
+		}
+
+		channels = channel_count;
+		return true;
+	}
+
+	void Free()
+	{
+		if (samples)
+		{
+			av_freep(&samples);
+		}
+
+		capacity = 0;
+		channels = 0;
+		head.store(0);
+		tail.store(0);
+		discard.store(0);
+	}
+
+	unsigned int Capacity() const
+	{
+		return capacity;
+	}
+
+	unsigned int Count() const
+	{
+		return head.load(std::memory_order_acquire) - ReadIndex();
+	}
+
+	// Producer: drops everything written so far, the consumer skips it on its next read
+	void Discard()
+	{
+		discard.store(head.load(std::memory_order_relaxed), std::memory_order_release);
+	}
+
+	// Producer: copies as many frames as fit and returns how many were written
+	unsigned int Write(const float* src, unsigned int count)
+	{
+		unsigned int index = head.load(std::memory_order_relaxed);
+		unsigned int space = capacity - (index - tail.load(std::memory_order_acquire));
+
+		if (count > space)
+			count = space;
+
+		unsigned int offset = index & (capacity - 1);
+		unsigned int first = capacity - offset < count ? capacity - offset : count;
+
+		memcpy(samples + offset * channels, src, first * channels * sizeof(float));
+		memcpy(samples, src + first * channels, (count - first) * channels * sizeof(float));
+
+		head.store(index + count, std::memory_order_release);
+		return count;
+	}
+
+	// Consumer: copies up to count frames and returns how many were read
+	unsigned int Read(float* dst, unsigned int count)
+	{
+		unsigned int index = ReadIndex();
+		unsigned int available = head.load(std::memory_order_acquire) - index;
+
+		if (count > available)
+			count = available;
+
+		unsigned int offset = index & (capacity - 1);
+		unsigned int first = capacity - offset < count ? capacity - offset : count;
+
+		memcpy(dst, samples + offset * channels, first * channels * sizeof(float));
+		memcpy(dst + first * channels, samples, (count - first) * channels * sizeof(float));
+
+		tail.store(index + count, std::memory_order_release);
+		return count;
+	}
+};
@@ -18,23 +18,27 @@
  */
 
 #include "bass_vgmstream.h"
+#include "bass_vgmstream_ahead.h"
+#include "bass_vgmstream_cache.h"
 
+#include <windows.h>
 #include <vgmstream.h>
 #include <stdlib.h>
 
 /**
- * Callback for BASS. Called when it needs more data.
+ * Renders the stream into a BASS buffer of 16-bit or float samples.
  */
-DWORD CALLBACK vgmStreamProc(
+static DWORD vgmStreamRender(
     HSTREAM handle,
     void *buffer,
     DWORD length,
-    void *user
+    VGMSTREAM *stream,
+    BOOL is_float
 )
 {
-	VGMSTREAM* stream = (VGMSTREAM*)user;                         // We passed the VGMSTREAM as user data.
+	int sample_size = is_float ? sizeof(float) : sizeof(sample);  // Size of one output sample.
 	BOOL ended = FALSE;                                           // Used to signal end of stream.
-	int max_samples = length / sizeof(sample) / stream->channels; // Calculate the maximum amount of samples from max buffer size.
+	int max_samples = length / sample_size / stream->channels;    // Calculate the maximum amount of samples from max buffer size.
 	int samples_to_do;                                            // Will hold the amount of samples to be copied.
 	
 	// If this is a looping VGM stream, we handle it as an infinite stream and read out the
@@ -50,9 +54,12 @@ DWORD CALLBACK vgmStreamProc(
 		samples_to_do = max_samples;
 
 	// Render the stream.
-	render_vgmstream((sample*)buffer, samples_to_do, stream);
+	if (is_float)
+		render_vgmstream_f32((float*)buffer, samples_to_do, stream);
+	else
+		render_vgmstream((sample*)buffer, samples_to_do, stream);
 	// BASS expects you to return the amount of data read in bytes, so multiply by the sample size
-	samples_to_do *= sizeof(sample) * stream->channels;
+	samples_to_do *= sample_size * stream->channels;
 
 	// If we reached the end of a non-looping VGM stream, we'll check BASS' loop flag.
 	// If it is set, we restart from the beginning. Otherwise, we signal the end of stream
@@ -67,6 +74,42 @@ DWORD CALLBACK vgmStreamProc(
 	return samples_to_do;
 }
 
+/**
+ * Callback for BASS. Called when it needs more data.
+ */
+DWORD CALLBACK vgmStreamProc(
+    HSTREAM handle,
+    void *buffer,
+    DWORD length,
+    void *user
+)
+{
+	// We passed the VGMSTREAM as user data.
+	return vgmStreamRender(handle, buffer, length, (VGMSTREAM*)user, FALSE);
+}
+
+/**
+ * Callback for BASS_SAMPLE_FLOAT streams. Samples are rendered as float without
+ * going through 16-bit, so BASS gets the mixing and fades without clipping.
+ */
+DWORD CALLBACK vgmStreamProcFloat(
+    HSTREAM handle,
+    void *buffer,
+    DWORD length,
+    void *user
+)
+{
+	return vgmStreamRender(handle, buffer, length, (VGMSTREAM*)user, TRUE);
+}
+
+/**
+ * Picks the callback for the sample format requested in the stream flags.
+ */
+static STREAMPROC* vgmStreamProcFor(DWORD flags)
+{
+	return (flags & BASS_SAMPLE_FLOAT) ? &vgmStreamProcFloat : &vgmStreamProc;
+}
+
 /**
  * Called when the BASS handle is closed
  */
@@ -81,31 +124,95 @@ void CALLBACK vgmStreamOnFree(
 	close_vgmstream(stream);
 }
 
-BASS_VGMSTREAM_API HSTREAM BASS_VGMSTREAM_StreamCreate(const char* file, DWORD flags)
+/**
+ * Creates the BASS stream for a VGMSTREAM, decoding it in the STREAMPROC or ahead on the worker pool
+ */
+static HSTREAM vgmStreamCreate(VGMSTREAM* vgmstream, DWORD flags, DWORD options)
 {
 	HSTREAM h;
-	VGMSTREAM* stream = init_vgmstream(file);
-	if(!stream)
+	vgmAheadStream* ahead;
+
+	if (!(options & BASS_VGMSTREAM_DECODE_AHEAD))
+	{
+		h = BASS_StreamCreate(vgmstream->sample_rate, vgmstream->channels, flags, vgmStreamProcFor(flags), vgmstream);
+		if (!h)
+			return 0;
+
+		BASS_ChannelSetSync(h, BASS_SYNC_FREE | BASS_SYNC_MIXTIME, 0, &vgmStreamOnFree, vgmstream);
+		return h;
+	}
+
+	ahead = vgmAheadCreate(vgmstream, (flags & BASS_SAMPLE_FLOAT) != 0);
+	if (!ahead)
 		return 0;
 
-	h = BASS_StreamCreate(stream->sample_rate, stream->channels, flags, &vgmStreamProc, stream);
-	if(!h)
+	h = BASS_StreamCreate(vgmstream->sample_rate, vgmstream->channels, flags, &vgmAheadStreamProc, ahead);
+	if (!h)
+	{
+		vgmAheadFree(ahead);
 		return 0;
+	}
 
-	BASS_ChannelSetSync(h, BASS_SYNC_FREE|BASS_SYNC_MIXTIME, 0, &vgmStreamOnFree, stream);
+	BASS_ChannelSetSync(h, BASS_SYNC_FREE | BASS_SYNC_MIXTIME, 0, &vgmAheadOnFree, ahead);
+	vgmAheadStart(ahead);
 	return h;
 }
 
+// vgmstream looks files up in the active index without locking it. Files are opened holding this lock shared
+// and LoadIndex swaps the index holding it exclusively, so the index it frees is no longer in use.
+static SRWLOCK index_lock = SRWLOCK_INIT;
+static vgmstream_index_t* loaded_index = NULL;
+
+void vgmIndexLockShared(void)
+{
+	AcquireSRWLockShared(&index_lock);
+}
+
+void vgmIndexUnlockShared(void)
+{
+	ReleaseSRWLockShared(&index_lock);
+}
+
+BASS_VGMSTREAM_API HSTREAM BASS_VGMSTREAM_StreamCreateEx(const char* file, DWORD flags, DWORD options)
+{
+	vgmIndexLockShared();
+	VGMSTREAM* stream = init_vgmstream(file);
+	vgmIndexUnlockShared();
+	if(!stream)
+		return 0;
+
+	return vgmStreamCreate(stream, flags, options);
+}
+
+BASS_VGMSTREAM_API HSTREAM BASS_VGMSTREAM_StreamCreate(const char* file, DWORD flags)
+{
+	return BASS_VGMSTREAM_StreamCreateEx(file, flags, 0);
+}
+
 STREAMFILE* open_memory_streamfile(uint8_t* buf, size_t bufsize, const char* name);
 
-BASS_VGMSTREAM_API HSTREAM BASS_VGMSTREAM_StreamCreateFromMemory(unsigned char* buf, int bufsize, const char* name, DWORD flags)
+BASS_VGMSTREAM_API HSTREAM BASS_VGMSTREAM_StreamCreateFromMemoryEx(unsigned char* buf, int bufsize, const char* name, DWORD flags, DWORD options)
 {
 	HSTREAM h;
+	vgmCacheKey key;
+	BOOL cacheable;
+
 	if (!buf)
 		return 0;
 
+	// Clips played before only copy PCM, decoding ahead doesn't apply to them
+	cacheable = vgmCacheKeyInit(&key, buf, bufsize, name);
+	if (cacheable)
+	{
+		h = vgmCacheStreamCreate(&key, flags);
+		if (h)
+			return h;
+	}
+
 	STREAMFILE* sf = open_memory_streamfile(buf, bufsize, name);
+	vgmIndexLockShared();
 	VGMSTREAM* vgmstream = init_vgmstream_from_STREAMFILE(sf);
+	vgmIndexUnlockShared();
 
 	if (!vgmstream)
 		return 0;
@@ -119,10 +226,44 @@ BASS_VGMSTREAM_API HSTREAM BASS_VGMSTREAM_StreamCreateFromMemory(unsigned char*
 			vgmstream->loop_flag = 0; // Disable invalid loops (B01_00_02 in HIGHWAY_BANK01)
 	}
 
-	h = BASS_StreamCreate(vgmstream->sample_rate, vgmstream->channels, flags, &vgmStreamProc, vgmstream);
-	if (!h)
-		return 0;
+	// The first stream of a clip fills the cache as it decodes in the STREAMPROC, which decoding ahead avoids
+	h = cacheable && !(options & BASS_VGMSTREAM_DECODE_AHEAD) ? vgmCacheStreamCreateFrom(&key, vgmstream, flags) : 0;
+	if (h)
+		return h;
 
-	BASS_ChannelSetSync(h, BASS_SYNC_FREE | BASS_SYNC_MIXTIME, 0, &vgmStreamOnFree, vgmstream);
-	return h;
-}
\ No newline at end of file
+	return vgmStreamCreate(vgmstream, flags, options);
+}
+
+BASS_VGMSTREAM_API HSTREAM BASS_VGMSTREAM_StreamCreateFromMemory(unsigned char* buf, int bufsize, const char* name, DWORD flags)
+{
+	return BASS_VGMSTREAM_StreamCreateFromMemoryEx(buf, bufsize, name, flags, 0);
+}
+
+BASS_VGMSTREAM_API void BASS_VGMSTREAM_SetCacheSize(DWORD bytes)
+{
+	vgmCacheSetBudget(bytes);
+}
+
+BASS_VGMSTREAM_API BOOL BASS_VGMSTREAM_LoadIndex(const char* file)
+{
+	vgmstream_index_t* index = NULL;
+
+	if (file)
+	{
+		STREAMFILE* sf = open_stdio_streamfile(file);
+		if (!sf)
+			return FALSE;
+
+		index = vgmstream_index_load(sf);
+		close_streamfile(sf);
+		if (!index)
+			return FALSE;
+	}
+
+	AcquireSRWLockExclusive(&index_lock);
+	vgmstream_index_set(index);
+	vgmstream_index_close(loaded_index);
+	loaded_index = index;
+	ReleaseSRWLockExclusive(&index_lock);
+	return TRUE;
+}
@@ -28,13 +28,37 @@
 
 #include <bass.h>
 
+// Options for the StreamCreateEx functions
+#define BASS_VGMSTREAM_DECODE_AHEAD 1 // Decode on worker threads instead of in BASS's mixing thread
+
+// Stream info filled by BASS_VGMSTREAM_Probe
+typedef struct
+{
+	DWORD sample_rate;
+	DWORD channels;
+	DWORD samples;     // Samples per channel
+	BOOL loop;
+	DWORD loop_start;
+	DWORD loop_end;
+} BASS_VGMSTREAM_INFO;
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif
+	// Streams created with BASS_SAMPLE_FLOAT are rendered as float samples instead of 16-bit
 	BASS_VGMSTREAM_API HSTREAM BASS_VGMSTREAM_StreamCreate(const char* file, DWORD flags);
 	BASS_VGMSTREAM_API HSTREAM BASS_VGMSTREAM_StreamCreateFromMemory(unsigned char* buf, int bufsize, const char* name, DWORD flags);
+	// Same, with BASS_VGMSTREAM_* options
+	BASS_VGMSTREAM_API HSTREAM BASS_VGMSTREAM_StreamCreateEx(const char* file, DWORD flags, DWORD options);
+	BASS_VGMSTREAM_API HSTREAM BASS_VGMSTREAM_StreamCreateFromMemoryEx(unsigned char* buf, int bufsize, const char* name, DWORD flags, DWORD options);
+	// Memory budget in bytes for clips decoded by StreamCreateFromMemory, 0 disables the cache (default 16 MB)
+	BASS_VGMSTREAM_API void BASS_VGMSTREAM_SetCacheSize(DWORD bytes);
+	// Loads a metadata index made with vgmstream-cli -B, files found in it are opened without format detection
+	// or key searches. NULL unloads it. May be called while other threads create streams, it waits for them.
+	BASS_VGMSTREAM_API BOOL BASS_VGMSTREAM_LoadIndex(const char* file);
+	// Detects the format and fills info without setting up playback, returns FALSE if the data isn't supported
+	BASS_VGMSTREAM_API BOOL BASS_VGMSTREAM_Probe(void* data, int size, const char* name, BASS_VGMSTREAM_INFO* info);
 	BASS_VGMSTREAM_API void* BASS_VGMSTREAM_InitVGMStreamFromMemory(void* data, int size, const char* name);
 	BASS_VGMSTREAM_API void BASS_VGMSTREAM_CloseVGMStream(void* vgmstream);
 	BASS_VGMSTREAM_API int BASS_VGMSTREAM_GetVGMStreamOutputSize(void* vgmstream);
@@ -0,0 +1,289 @@
+#include "bass_vgmstream_ahead.h"
+
+#include <windows.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define AHEAD_WORKERS 2      // Worker threads shared by all streams
+#define AHEAD_LENGTH  32768  // Frames in each ring buffer, must be a power of two
+#define AHEAD_BLOCK   2048   // Frames decoded per step
+
+struct vgmAheadStream
+{
+	VGMSTREAM* vgmstream;
+	BOOL is_float;
+	int frame_size;          // Bytes per frame of all channels
+	uint8_t* ring;
+
+	volatile LONG read;      // Frames copied out by BASS, only written by the STREAMPROC
+	volatile LONG write;     // Frames decoded, only written by the decoding thread
+	volatile LONG ended;     // write is the end of the stream, BASS decides there whether it loops
+
+	// Protected by the pool lock
+	BOOL busy;               // A worker is decoding this stream
+	BOOL linked;
+	vgmAheadStream* next;
+};
+
+static SRWLOCK pool_lock = SRWLOCK_INIT;
+static CONDITION_VARIABLE pool_work = CONDITION_VARIABLE_INIT; // A ring has room or a stream was added
+static CONDITION_VARIABLE pool_idle = CONDITION_VARIABLE_INIT; // A worker finished a block
+static vgmAheadStream* pool_streams = NULL;
+static int pool_workers = 0;
+
+static LONG vgmAheadLoad(volatile LONG* value)
+{
+	return InterlockedCompareExchange(value, 0, 0);
+}
+
+static DWORD vgmAheadRoom(const vgmAheadStream* ahead)
+{
+	return AHEAD_LENGTH - (DWORD)(vgmAheadLoad((volatile LONG*)&ahead->write) - vgmAheadLoad((volatile LONG*)&ahead->read));
+}
+
+/**
+ * Decodes the next block into the ring. Stops exactly where the synchronous STREAMPROC would end,
+ * whether to restart there is decided when BASS reaches it.
+ */
+static void vgmAheadDecode(vgmAheadStream* ahead)
+{
+	VGMSTREAM* vgmstream = ahead->vgmstream;
+	LONG write = ahead->write;
+	DWORD offset = (DWORD)write & (AHEAD_LENGTH - 1);
+	DWORD room = vgmAheadRoom(ahead);
+	int samples_to_do = AHEAD_BLOCK;
+	BOOL ended = FALSE;
+	void* buffer = ahead->ring + offset * ahead->frame_size;
+
+	// Blocks never wrap around the end of the ring
+	if (samples_to_do > (int)(AHEAD_LENGTH - offset))
+		samples_to_do = AHEAD_LENGTH - offset;
+	if (samples_to_do > (int)room)
+		samples_to_do = room;
+
+	if (!vgmstream->loop_flag && vgmstream->current_sample + samples_to_do >= vgmstream->num_samples) {
+		samples_to_do = vgmstream->num_samples - vgmstream->current_sample;
+		if (samples_to_do < 0)
+			samples_to_do = 0;
+		ended = TRUE;
+	}
+
+	if (ahead->is_float)
+		render_vgmstream_f32((float*)buffer, samples_to_do, vgmstream);
+	else
+		render_vgmstream((sample*)buffer, samples_to_do, vgmstream);
+
+	InterlockedExchange(&ahead->write, write + samples_to_do);
+
+	if (ended)
+		InterlockedExchange(&ahead->ended, TRUE);
+}
+
+/**
+ * Restarts an ended stream for BASS_SAMPLE_LOOP and decodes its first block right away, as BASS is
+ * waiting for it. Called from the STREAMPROC once everything before the end was copied out.
+ */
+static void vgmAheadRestart(vgmAheadStream* ahead)
+{
+	AcquireSRWLockExclusive(&pool_lock);
+
+	// A worker may still be returning from the block that ended the stream
+	while (ahead->busy)
+		SleepConditionVariableSRW(&pool_idle, &pool_lock, INFINITE, 0);
+	ahead->busy = TRUE;
+
+	ReleaseSRWLockExclusive(&pool_lock);
+
+	reset_vgmstream(ahead->vgmstream);
+	InterlockedExchange(&ahead->ended, FALSE);
+	vgmAheadDecode(ahead);
+
+	AcquireSRWLockExclusive(&pool_lock);
+	ahead->busy = FALSE;
+	WakeAllConditionVariable(&pool_idle);
+	WakeConditionVariable(&pool_work);
+	ReleaseSRWLockExclusive(&pool_lock);
+}
+
+/**
+ * Picks the stream with the least decoded audio that has room for a block. Called with the pool lock held.
+ */
+static vgmAheadStream* vgmAheadNext(void)
+{
+	vgmAheadStream* best = NULL;
+	DWORD best_room = 0;
+	vgmAheadStream* ahead;
+
+	for (ahead = pool_streams; ahead; ahead = ahead->next) {
+		DWORD room;
+
+		if (ahead->busy || vgmAheadLoad(&ahead->ended))
+			continue;
+
+		room = vgmAheadRoom(ahead);
+		if (room >= AHEAD_BLOCK && room > best_room) {
+			best = ahead;
+			best_room = room;
+		}
+	}
+
+	return best;
+}
+
+/**
+ * Workers run for the lifetime of the process, they sleep while every ring is full.
+ */
+static DWORD WINAPI vgmAheadWorker(LPVOID param)
+{
+	AcquireSRWLockExclusive(&pool_lock);
+
+	for (;;) {
+		vgmAheadStream* ahead = vgmAheadNext();
+		if (!ahead) {
+			SleepConditionVariableSRW(&pool_work, &pool_lock, INFINITE, 0);
+			continue;
+		}
+
+		ahead->busy = TRUE;
+		ReleaseSRWLockExclusive(&pool_lock);
+
+		vgmAheadDecode(ahead);
+
+		AcquireSRWLockExclusive(&pool_lock);
+		ahead->busy = FALSE;
+		WakeAllConditionVariable(&pool_idle);
+	}
+
+	return 0;
+}
+
+vgmAheadStream* vgmAheadCreate(VGMSTREAM* vgmstream, BOOL is_float)
+{
+	vgmAheadStream* ahead = (vgmAheadStream*)calloc(1, sizeof(vgmAheadStream));
+	if (!ahead) {
+		close_vgmstream(vgmstream);
+		return NULL;
+	}
+
+	ahead->vgmstream = vgmstream;
+	ahead->is_float = is_float;
+	ahead->frame_size = (is_float ? sizeof(float) : sizeof(sample)) * vgmstream->channels;
+	ahead->ring = (uint8_t*)malloc(AHEAD_LENGTH * ahead->frame_size);
+	if (!ahead->ring) {
+		vgmAheadFree(ahead);
+		return NULL;
+	}
+
+	return ahead;
+}
+
+void vgmAheadStart(vgmAheadStream* ahead)
+{
+	// The first block is ready before playback starts
+	vgmAheadDecode(ahead);
+
+	AcquireSRWLockExclusive(&pool_lock);
+
+	ahead->next = pool_streams;
+	ahead->linked = TRUE;
+	pool_streams = ahead;
+
+	while (pool_workers < AHEAD_WORKERS) {
+		HANDLE thread = CreateThread(NULL, 0, vgmAheadWorker, NULL, 0, NULL);
+		if (!thread)
+			break;
+
+		CloseHandle(thread);
+		pool_workers++;
+	}
+
+	WakeConditionVariable(&pool_work);
+	ReleaseSRWLockExclusive(&pool_lock);
+}
+
+void vgmAheadFree(vgmAheadStream* ahead)
+{
+	AcquireSRWLockExclusive(&pool_lock);
+
+	if (ahead->linked) {
+		vgmAheadStream** link = &pool_streams;
+		while (*link != ahead)
+			link = &(*link)->next;
+
+		*link = ahead->next;
+		ahead->linked = FALSE;
+	}
+
+	// Unlinked streams aren't picked again, but one may still be decoding
+	while (ahead->busy)
+		SleepConditionVariableSRW(&pool_idle, &pool_lock, INFINITE, 0);
+
+	ReleaseSRWLockExclusive(&pool_lock);
+
+	close_vgmstream(ahead->vgmstream);
+	free(ahead->ring);
+	free(ahead);
+}
+
+/**
+ * Copies out up to frames decoded frames, returns how many there were.
+ */
+static DWORD vgmAheadCopy(vgmAheadStream* ahead, uint8_t* buffer, DWORD frames)
+{
+	LONG read = ahead->read;
+	DWORD available = (DWORD)(vgmAheadLoad(&ahead->write) - read);
+	DWORD offset = (DWORD)read & (AHEAD_LENGTH - 1);
+	DWORD first;
+
+	if (frames > available)
+		frames = available;
+
+	// Copy up to the end of the ring, then from its start
+	first = AHEAD_LENGTH - offset;
+	if (first > frames)
+		first = frames;
+
+	memcpy(buffer, ahead->ring + offset * ahead->frame_size, first * ahead->frame_size);
+	memcpy(buffer + first * ahead->frame_size, ahead->ring, (frames - first) * ahead->frame_size);
+
+	InterlockedExchange(&ahead->read, read + frames);
+	return frames;
+}
+
+/**
+ * Callback for BASS, copies out what the workers decoded.
+ */
+DWORD CALLBACK vgmAheadStreamProc(HSTREAM handle, void* buffer, DWORD length, void* user)
+{
+	vgmAheadStream* ahead = (vgmAheadStream*)user;
+	BOOL ended = vgmAheadLoad(&ahead->ended);   // Read first, write is final once it is set
+	DWORD frames = length / ahead->frame_size;
+	DWORD done = vgmAheadCopy(ahead, (uint8_t*)buffer, frames);
+
+	// Like the synchronous STREAMPROC, BASS_SAMPLE_LOOP is checked when playback gets to the end
+	if (ended && vgmAheadLoad(&ahead->write) == ahead->read) {
+		if (!(BASS_ChannelFlags(handle, 0, 0) & BASS_SAMPLE_LOOP))
+			return (done * ahead->frame_size) | BASS_STREAMPROC_END;
+
+		vgmAheadRestart(ahead);
+		done += vgmAheadCopy(ahead, (uint8_t*)buffer + done * ahead->frame_size, frames - done);
+		ended = vgmAheadLoad(&ahead->ended);
+	}
+
+	// Taking the lock makes sure a worker that just found the ring full doesn't miss this
+	if (!ended && vgmAheadRoom(ahead) >= AHEAD_BLOCK) {
+		AcquireSRWLockExclusive(&pool_lock);
+		WakeConditionVariable(&pool_work);
+		ReleaseSRWLockExclusive(&pool_lock);
+	}
+
+	return done * ahead->frame_size;
+}
+
+/**
+ * Called when the BASS handle is closed
+ */
+void CALLBACK vgmAheadOnFree(HSYNC handle, DWORD channel, DWORD data, void* user)
+{
+	vgmAheadFree((vgmAheadStream*)user);
+}
@@ -0,0 +1,26 @@
+#ifndef _BASS_VGMSTREAM_AHEAD_H_
+#define _BASS_VGMSTREAM_AHEAD_H_
+
+#include <bass.h>
+#include <vgmstream.h>
+
+/**
+ * Decode-ahead for vgmstream BASS streams. A shared pool of worker threads decodes each stream
+ * into its own PCM ring buffer, so the STREAMPROC only copies samples out and an expensive block
+ * or a slow file read doesn't hold up BASS's mixing thread.
+ */
+typedef struct vgmAheadStream vgmAheadStream;
+
+// Takes over the VGMSTREAM, which is closed with the ahead stream
+vgmAheadStream* vgmAheadCreate(VGMSTREAM* vgmstream, BOOL is_float);
+
+// Decodes the first block and hands the stream to the workers, once its BASS handle exists
+void vgmAheadStart(vgmAheadStream* ahead);
+
+// Waits until no worker decodes the stream anymore, then frees it and its VGMSTREAM
+void vgmAheadFree(vgmAheadStream* ahead);
+
+DWORD CALLBACK vgmAheadStreamProc(HSTREAM handle, void* buffer, DWORD length, void* user);
+void CALLBACK vgmAheadOnFree(HSYNC handle, DWORD channel, DWORD data, void* user);
+
+#endif
@@ -0,0 +1,329 @@
+#include "bass_vgmstream_cache.h"
+
+#include <windows.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_DEFAULT_BUDGET (16 * 1024 * 1024) // Bytes of PCM kept by default
+#define CACHE_CLIP_SHARE     4                  // A single clip may use at most this fraction of the budget
+#define CACHE_NAME_LENGTH    64
+
+typedef struct vgmCacheEntry vgmCacheEntry;
+
+struct vgmCacheEntry
+{
+	// Key
+	uint64_t hash;
+	int bufsize;
+	char name[CACHE_NAME_LENGTH];
+	BOOL is_float;
+
+	void* pcm;                // Samples of all channels, float or 16-bit
+	int frame_size;           // Bytes per sample of all channels
+	int channels;
+	int sample_rate;
+	int32_t samples;          // Samples per channel in pcm
+	int32_t filled;           // Samples decoded so far, only less than samples before the clip is cached
+	int32_t loop_start;       // The clip loops back here from its end, -1 if it doesn't loop
+	size_t bytes;
+
+	LONG refs;                // The cache and every open stream hold a reference
+	vgmCacheEntry* prev;      // Less recently used
+	vgmCacheEntry* next;      // More recently used
+};
+
+typedef struct
+{
+	vgmCacheEntry* entry;
+	int32_t position;
+	VGMSTREAM* vgmstream;     // Set while this stream decodes the clip
+} vgmCacheStream;
+
+static SRWLOCK cache_lock = SRWLOCK_INIT;
+static vgmCacheEntry* cache_oldest = NULL;
+static vgmCacheEntry* cache_newest = NULL;
+static size_t cache_bytes = 0;
+static size_t cache_budget = CACHE_DEFAULT_BUDGET;
+
+/**
+ * FNV-1a over the whole buffer, the data may be reused or reloaded at the same address.
+ */
+static uint64_t vgmCacheHash(const void* buf, int bufsize)
+{
+	const uint8_t* data = (const uint8_t*)buf;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	int i;
+
+	for (i = 0; i < bufsize; i++) {
+		hash ^= data[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+static void vgmCacheRelease(vgmCacheEntry* entry)
+{
+	if (InterlockedDecrement(&entry->refs) == 0) {
+		free(entry->pcm);
+		free(entry);
+	}
+}
+
+// Called with the cache lock held
+static void vgmCacheUnlink(vgmCacheEntry* entry)
+{
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		cache_oldest = entry->next;
+
+	if (entry->next)
+		entry->next->prev = entry->prev;
+	else
+		cache_newest = entry->prev;
+
+	entry->prev = NULL;
+	entry->next = NULL;
+}
+
+// Called with the cache lock held
+static void vgmCacheLinkNewest(vgmCacheEntry* entry)
+{
+	entry->prev = cache_newest;
+	entry->next = NULL;
+
+	if (cache_newest)
+		cache_newest->next = entry;
+	else
+		cache_oldest = entry;
+
+	cache_newest = entry;
+}
+
+// Called with the cache lock held. Clips still playing stay alive until their streams are freed.
+static void vgmCacheEvict(size_t budget)
+{
+	while (cache_oldest && cache_bytes > budget) {
+		vgmCacheEntry* entry = cache_oldest;
+		vgmCacheUnlink(entry);
+		cache_bytes -= entry->bytes;
+		vgmCacheRelease(entry);
+	}
+}
+
+BOOL vgmCacheKeyInit(vgmCacheKey* key, const void* buf, int bufsize, const char* name)
+{
+	size_t budget = cache_budget;
+
+	// Decoded PCM is never smaller than the data, so skip hashing clips that can't fit anyway
+	if (!budget || (size_t)bufsize > budget / CACHE_CLIP_SHARE)
+		return FALSE;
+
+	key->hash = vgmCacheHash(buf, bufsize);
+	key->bufsize = bufsize;
+	key->name = name ? name : "";
+	return TRUE;
+}
+
+void vgmCacheSetBudget(DWORD bytes)
+{
+	AcquireSRWLockExclusive(&cache_lock);
+	cache_budget = bytes;
+	vgmCacheEvict(cache_budget);
+	ReleaseSRWLockExclusive(&cache_lock);
+}
+
+/**
+ * Adds the clip decoded by its first stream, unless the same one was cached meanwhile by another stream.
+ */
+static void vgmCachePublish(vgmCacheEntry* entry)
+{
+	vgmCacheEntry* cached;
+
+	AcquireSRWLockExclusive(&cache_lock);
+
+	for (cached = cache_newest; cached; cached = cached->prev) {
+		if (cached->hash == entry->hash && cached->bufsize == entry->bufsize && cached->is_float == entry->is_float &&
+				strcmp(cached->name, entry->name) == 0)
+			break;
+	}
+
+	if (!cached && entry->bytes <= cache_budget / CACHE_CLIP_SHARE) {
+		InterlockedIncrement(&entry->refs);
+		vgmCacheLinkNewest(entry);
+		cache_bytes += entry->bytes;
+		vgmCacheEvict(cache_budget);
+	}
+
+	ReleaseSRWLockExclusive(&cache_lock);
+}
+
+/**
+ * Decodes the clip up to the given sample, in the stream's own STREAMPROC call like an uncached stream.
+ */
+static void vgmCacheFill(vgmCacheStream* stream, int32_t until)
+{
+	vgmCacheEntry* entry = stream->entry;
+	void* buffer = (uint8_t*)entry->pcm + entry->filled * entry->frame_size;
+
+	// Decoded from the start, vgmstream doesn't loop before loop_end_sample
+	if (entry->is_float)
+		render_vgmstream_f32((float*)buffer, until - entry->filled, stream->vgmstream);
+	else
+		render_vgmstream((sample*)buffer, until - entry->filled, stream->vgmstream);
+	entry->filled = until;
+
+	if (entry->filled == entry->samples) {
+		close_vgmstream(stream->vgmstream);
+		stream->vgmstream = NULL;
+		vgmCachePublish(entry);
+	}
+}
+
+/**
+ * Callback for BASS, copies the next samples of the clip.
+ */
+static DWORD CALLBACK vgmCacheStreamProc(HSTREAM handle, void* buffer, DWORD length, void* user)
+{
+	vgmCacheStream* stream = (vgmCacheStream*)user;
+	vgmCacheEntry* entry = stream->entry;
+	int32_t max_samples = length / entry->frame_size;
+	int32_t done = 0;
+
+	while (done < max_samples) {
+		int32_t samples_to_do = entry->samples - stream->position;
+
+		if (samples_to_do > max_samples - done)
+			samples_to_do = max_samples - done;
+
+		if (stream->position + samples_to_do > entry->filled)
+			vgmCacheFill(stream, stream->position + samples_to_do);
+
+		memcpy((uint8_t*)buffer + done * entry->frame_size, (uint8_t*)entry->pcm + stream->position * entry->frame_size,
+			samples_to_do * entry->frame_size);
+
+		done += samples_to_do;
+		stream->position += samples_to_do;
+
+		if (stream->position < entry->samples)
+			continue;
+
+		// Same end handling as the vgmstream callback: loop points first, then BASS' loop flag
+		if (entry->loop_start >= 0)
+			stream->position = entry->loop_start;
+		else if (BASS_ChannelFlags(handle, 0, 0) & BASS_SAMPLE_LOOP)
+			stream->position = 0;
+		else
+			return (done * entry->frame_size) | BASS_STREAMPROC_END;
+	}
+
+	return done * entry->frame_size;
+}
+
+/**
+ * Called when the BASS handle is closed
+ */
+static void CALLBACK vgmCacheOnFree(HSYNC handle, DWORD channel, DWORD data, void* user)
+{
+	vgmCacheStream* stream = (vgmCacheStream*)user;
+	close_vgmstream(stream->vgmstream);
+	vgmCacheRelease(stream->entry);
+	free(stream);
+}
+
+/**
+ * Creates a stream of the clip and takes over one reference to it, and the VGMSTREAM that fills it if any.
+ * The VGMSTREAM is left to the caller on failure.
+ */
+static HSTREAM vgmCacheCreateStream(vgmCacheEntry* entry, VGMSTREAM* vgmstream, DWORD flags)
+{
+	HSTREAM h;
+	vgmCacheStream* stream = (vgmCacheStream*)calloc(1, sizeof(vgmCacheStream));
+	if (!stream) {
+		vgmCacheRelease(entry);
+		return 0;
+	}
+
+	stream->entry = entry;
+	stream->vgmstream = vgmstream;
+
+	if (entry->channels > 1)
+		flags &= ~BASS_SAMPLE_3D; // Cannot create 3D samples from stereo
+
+	h = BASS_StreamCreate(entry->sample_rate, entry->channels, flags, &vgmCacheStreamProc, stream);
+	if (!h) {
+		vgmCacheRelease(entry);
+		free(stream);
+		return 0;
+	}
+
+	BASS_ChannelSetSync(h, BASS_SYNC_FREE | BASS_SYNC_MIXTIME, 0, &vgmCacheOnFree, stream);
+	return h;
+}
+
+HSTREAM vgmCacheStreamCreate(const vgmCacheKey* key, DWORD flags)
+{
+	vgmCacheEntry* entry;
+	BOOL is_float = (flags & BASS_SAMPLE_FLOAT) != 0;
+
+	AcquireSRWLockExclusive(&cache_lock);
+
+	// Most recently used first, a burst of the same effect hits right away
+	for (entry = cache_newest; entry; entry = entry->prev) {
+		if (entry->hash == key->hash && entry->bufsize == key->bufsize && entry->is_float == is_float &&
+				strncmp(entry->name, key->name, CACHE_NAME_LENGTH - 1) == 0)
+			break;
+	}
+
+	if (entry) {
+		vgmCacheUnlink(entry);
+		vgmCacheLinkNewest(entry);
+		InterlockedIncrement(&entry->refs);
+	}
+
+	ReleaseSRWLockExclusive(&cache_lock);
+
+	if (!entry)
+		return 0;
+
+	return vgmCacheCreateStream(entry, NULL, flags);
+}
+
+HSTREAM vgmCacheStreamCreateFrom(const vgmCacheKey* key, VGMSTREAM* vgmstream, DWORD flags)
+{
+	vgmCacheEntry* entry;
+	BOOL is_float = (flags & BASS_SAMPLE_FLOAT) != 0;
+	BOOL loop = vgmstream->loop_flag && vgmstream->loop_start_sample < vgmstream->loop_end_sample;
+	int32_t samples = loop ? vgmstream->loop_end_sample : vgmstream->num_samples;
+	int frame_size = (is_float ? sizeof(float) : sizeof(sample)) * vgmstream->channels;
+	size_t bytes = (size_t)samples * frame_size;
+
+	if (samples <= 0 || bytes > cache_budget / CACHE_CLIP_SHARE)
+		return 0;
+
+	entry = (vgmCacheEntry*)calloc(1, sizeof(vgmCacheEntry));
+	if (!entry)
+		return 0;
+
+	entry->pcm = malloc(bytes);
+	if (!entry->pcm) {
+		free(entry);
+		return 0;
+	}
+
+	entry->hash = key->hash;
+	entry->bufsize = key->bufsize;
+	strncpy(entry->name, key->name, CACHE_NAME_LENGTH - 1);
+	entry->is_float = is_float;
+	entry->frame_size = frame_size;
+	entry->channels = vgmstream->channels;
+	entry->sample_rate = vgmstream->sample_rate;
+	entry->samples = samples;
+	entry->loop_start = loop ? vgmstream->loop_start_sample : -1;
+	entry->bytes = bytes;
+	entry->refs = 1; // The new stream, the cache takes another once the clip is complete
+
+	// Nothing is decoded here, the stream starts as fast as an uncached one
+	return vgmCacheCreateStream(entry, vgmstream, flags);
+}
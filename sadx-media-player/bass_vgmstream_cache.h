@@ -0,0 +1,37 @@
+#ifndef _BASS_VGMSTREAM_CACHE_H_
+#define _BASS_VGMSTREAM_CACHE_H_
+
+#include <bass.h>
+#include <vgmstream.h>
+
+/**
+ * Process-wide cache of decoded clips for streams created from memory. Short sound effects are
+ * decoded once, by the first stream as it plays, and later streams of the same data only copy PCM
+ * without detecting the format again.
+ * Clips are keyed by a hash of their content, their size, their name and the sample format (float clips are
+ * rendered like vgmStreamProcFloat, not converted from 16-bit), and evicted least recently used first.
+ */
+
+typedef struct
+{
+	uint64_t hash;
+	int bufsize;
+	const char* name;
+} vgmCacheKey;
+
+// Sets the memory budget in bytes, 0 disables caching. Shrinking evicts clips right away.
+void vgmCacheSetBudget(DWORD bytes);
+
+// Hashes the buffer into the key, once for both calls below. Returns FALSE if caching is disabled
+// or the data is too big for its clip to fit in the cache.
+BOOL vgmCacheKeyInit(vgmCacheKey* key, const void* buf, int bufsize, const char* name);
+
+// Creates a stream of a cached clip, or returns 0 if the data isn't cached
+HSTREAM vgmCacheStreamCreate(const vgmCacheKey* key, DWORD flags);
+
+// Creates a stream that decodes the VGMSTREAM into a new clip while playing, if the clip fits, or returns 0.
+// The clip is added to the cache once the stream decoded all of it. The stream takes over the VGMSTREAM,
+// the caller keeps it if 0 is returned.
+HSTREAM vgmCacheStreamCreateFrom(const vgmCacheKey* key, VGMSTREAM* vgmstream, DWORD flags);
+
+#endif
@@ -84,6 +84,8 @@ void make_wav_header(uint8_t* buf, int32_t sample_count, int32_t sample_rate, in
 
 // Read from memory: https://github.com/vgmstream/vgmstream/issues/662
 STREAMFILE* open_memory_streamfile(uint8_t* buf, size_t bufsize, const char* name);
+void vgmIndexLockShared(void);
+void vgmIndexUnlockShared(void);
 
 typedef struct {
 	STREAMFILE sf; /* pre-alloc'd part */
@@ -251,7 +253,43 @@ int Convert(VGMSTREAM* vgmstream, unsigned char* outputdata)
 BASS_VGMSTREAM_API void* BASS_VGMSTREAM_InitVGMStreamFromMemory(void* data, int size, const char* name)
 {
 	STREAMFILE* sf = open_memory_streamfile(data, size, name);
-	return (void*)init_vgmstream_from_STREAMFILE(sf);
+	VGMSTREAM* vgmstream;
+
+	vgmIndexLockShared();
+	vgmstream = init_vgmstream_from_STREAMFILE(sf);
+	vgmIndexUnlockShared();
+	return (void*)vgmstream;
+}
+
+BASS_VGMSTREAM_API BOOL BASS_VGMSTREAM_Probe(void* data, int size, const char* name, BASS_VGMSTREAM_INFO* info)
+{
+	vgmstream_probe_info probe;
+	STREAMFILE* sf;
+	int res;
+
+	if (!data || !info)
+		return FALSE;
+
+	sf = open_memory_streamfile(data, size, name);
+	if (!sf)
+		return FALSE;
+
+	vgmIndexLockShared();
+	res = probe_vgmstream_from_STREAMFILE(sf, &probe);
+	vgmIndexUnlockShared();
+	close_streamfile(sf);
+	if (!res)
+		return FALSE;
+
+	info->sample_rate = probe.sample_rate;
+	info->channels = probe.channels;
+	info->samples = probe.num_samples;
+	info->loop = probe.loop_flag != 0;
+	if (probe.loop_start_sample <= 1 && probe.loop_end_sample == 1)
+		info->loop = FALSE; // Same as the streams, which don't play these loops (B01_00_02 in HIGHWAY_BANK01)
+	info->loop_start = probe.loop_start_sample;
+	info->loop_end = probe.loop_end_sample;
+	return TRUE;
 }
 
 BASS_VGMSTREAM_API void BASS_VGMSTREAM_CloseVGMStream(void* vgmstream)
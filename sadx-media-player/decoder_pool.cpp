@@ -0,0 +1,157 @@
+#include "decoder_pool.h"
+
+#include <algorithm>
+
+DecoderPool& DecoderPool::Instance()
+{
+	static DecoderPool pool;
+	return pool;
+}
+
+void DecoderPool::Worker()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (!stop)
+	{
+		auto now = std::chrono::steady_clock::now();
+		auto next = std::chrono::steady_clock::time_point::max();
+		DecoderJob* job = nullptr;
+
+		// Jobs are kept in round-robin order, the first runnable one wins
+		for (auto it = jobs.begin(); it != jobs.end(); ++it)
+		{
+			DecoderJob* candidate = *it;
+
+			if (candidate->running)
+				continue;
+
+			if (candidate->signaled || candidate->wake_time <= now)
+			{
+				job = candidate;
+				jobs.erase(it);
+				jobs.push_back(job);
+				break;
+			}
+
+			next = std::min(next, candidate->wake_time);
+		}
+
+		if (!job)
+		{
+			if (next == std::chrono::steady_clock::time_point::max())
+				work.wait(lock);
+			else
+				work.wait_until(lock, next);
+			continue;
+		}
+
+		job->running = true;
+		job->signaled = false;
+		lock.unlock();
+
+		auto deadline = std::chrono::steady_clock::time_point::max();
+		bool again = job->Run(deadline);
+
+		lock.lock();
+		job->running = false;
+		job->wake_time = deadline;
+
+		if (again)
+		{
+			job->signaled = true;
+		}
+
+		// Another worker may be able to run the job now, and Remove may be waiting for it
+		work.notify_one();
+		idle.notify_all();
+	}
+}
+
+void DecoderPool::Add(DecoderJob* job)
+{
+	std::lock_guard<std::mutex> control(control_mutex);
+	std::lock_guard<std::mutex> lock(mutex);
+
+	job->running = false;
+	job->signaled = true;
+	jobs.push_back(job);
+
+	int count = (int)std::thread::hardware_concurrency();
+	if (count > MaxWorkers)
+		count = MaxWorkers;
+	if (count > (int)jobs.size())
+		count = (int)jobs.size();
+
+	while ((int)workers.size() < count || workers.empty())
+	{
+		workers.emplace_back(&DecoderPool::Worker, this);
+	}
+
+	work.notify_one();
+}
+
+void DecoderPool::Remove(DecoderJob* job)
+{
+	std::lock_guard<std::mutex> control(control_mutex);
+	std::vector<std::thread> stopped;
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+
+		auto it = std::find(jobs.begin(), jobs.end(), job);
+		if (it == jobs.end())
+		{
+			return;
+		}
+
+		jobs.erase(it);
+
+		while (job->running)
+		{
+			idle.wait(lock);
+		}
+
+		if (jobs.empty())
+		{
+			stop = true;
+			stopped.swap(workers);
+			work.notify_all();
+		}
+	}
+
+	for (auto& worker : stopped)
+	{
+		worker.join();
+	}
+
+	if (!stopped.empty())
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = false;
+	}
+}
+
+void DecoderPool::Wake(DecoderJob* job)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	job->signaled = true;
+	work.notify_one();
+}
+
+DecoderPool::~DecoderPool()
+{
+	std::vector<std::thread> stopped;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+		stopped.swap(workers);
+		work.notify_all();
+	}
+
+	for (auto& worker : stopped)
+	{
+		worker.join();
+	}
+}
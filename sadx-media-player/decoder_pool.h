@@ -0,0 +1,56 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work item scheduled on the decoder pool. A job is never run by two workers at once.
+class DecoderJob
+{
+	friend class DecoderPool;
+
+	bool running = false;
+	bool signaled = false;
+	std::chrono::steady_clock::time_point wake_time;
+
+public:
+	virtual ~DecoderJob() = default;
+
+	// Does a bounded amount of work. Returns true to be run again right away, or false to
+	// sleep until Wake() is called or the deadline is reached.
+	virtual bool Run(std::chrono::steady_clock::time_point& deadline) = 0;
+};
+
+// Worker threads shared by all video players. Workers are started when jobs are added
+// and stopped once the last job is removed, so no threads are left running at unload.
+class DecoderPool
+{
+private:
+	std::mutex control_mutex; // Serializes Add and Remove
+	std::mutex mutex;
+	std::condition_variable work;
+	std::condition_variable idle;
+
+	std::vector<DecoderJob*> jobs;
+	std::vector<std::thread> workers;
+	bool stop = false;
+
+	static constexpr int MaxWorkers = 4;
+
+	void Worker();
+
+public:
+	static DecoderPool& Instance();
+
+	void Add(DecoderJob* job);
+
+	// Waits until the job is no longer running before returning
+	void Remove(DecoderJob* job);
+
+	// Runs the job as soon as a worker is free
+	void Wake(DecoderJob* job);
+
+	~DecoderPool();
+};
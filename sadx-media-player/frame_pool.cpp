@@ -0,0 +1,200 @@
+#include "frame_pool.h"
+
+#include <malloc.h>
+#include <vector>
+
+extern "C"
+{
+#include "libavutil/imgutils.h"
+#include "libavutil/pixdesc.h"
+}
+
+AVBufferRef* FramePool::Alloc(void* opaque, size_t size)
+{
+	uint8_t* data = (uint8_t*)_aligned_malloc(size, Alignment);
+	if (!data)
+	{
+		return nullptr;
+	}
+
+	AVBufferRef* buffer = av_buffer_create(data, size, FreeBuffer, nullptr, 0);
+	if (!buffer)
+	{
+		_aligned_free(data);
+	}
+
+	return buffer;
+}
+
+void FramePool::FreeBuffer(void* opaque, uint8_t* data)
+{
+	_aligned_free(data);
+}
+
+int FramePool::GetBuffer2(AVCodecContext* pContext, AVFrame* pFrame, int flags)
+{
+	return ((FramePool*)pContext->opaque)->GetBuffer(pContext, pFrame, flags);
+}
+
+bool FramePool::Setup(AVCodecContext* pContext, const AVFrame* pFrame)
+{
+	if (pPool)
+	{
+		av_buffer_pool_uninit(&pPool);
+	}
+
+	format = -1;
+
+	// Same padding the decoder expects from the default allocator
+	int aligned_width = pFrame->width;
+	int aligned_height = pFrame->height;
+	int stride_align[AV_NUM_DATA_POINTERS];
+	avcodec_align_dimensions2(pContext, &aligned_width, &aligned_height, stride_align);
+
+	if (av_image_fill_linesizes(linesize, (AVPixelFormat)pFrame->format, aligned_width) < 0)
+	{
+		return false;
+	}
+
+	ptrdiff_t linesizes[4];
+	for (int i = 0; i < 4; ++i)
+	{
+		linesize[i] = (linesize[i] + Alignment - 1) & ~(Alignment - 1);
+		linesizes[i] = linesize[i];
+	}
+
+	size_t sizes[4];
+	if (av_image_fill_plane_sizes(sizes, (AVPixelFormat)pFrame->format, aligned_height, linesizes) < 0)
+	{
+		return false;
+	}
+
+	// All planes in one buffer, each one aligned and followed by room for overreads
+	size_t total = 0;
+	for (int i = 0; i < 4; ++i)
+	{
+		offset[i] = total;
+		if (sizes[i])
+		{
+			total += (sizes[i] + 16 + Alignment - 1) & ~(size_t)(Alignment - 1);
+		}
+	}
+
+	pPool = av_buffer_pool_init2(total, nullptr, Alloc, nullptr);
+	if (!pPool)
+	{
+		return false;
+	}
+
+	format = pFrame->format;
+	width = pFrame->width;
+	height = pFrame->height;
+	return true;
+}
+
+int FramePool::GetBuffer(AVCodecContext* pContext, AVFrame* pFrame, int flags)
+{
+	const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((AVPixelFormat)pFrame->format);
+
+	// Hardware and palette frames are left to the default allocator
+	if (!(pContext->codec->capabilities & AV_CODEC_CAP_DR1) || !desc || (desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL)))
+	{
+		return avcodec_default_get_buffer2(pContext, pFrame, flags);
+	}
+
+	AVBufferRef* buffer = nullptr;
+
+	{
+		// Frame threads allocate concurrently
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (pFrame->format != format || pFrame->width != width || pFrame->height != height)
+		{
+			if (!Setup(pContext, pFrame))
+			{
+				return avcodec_default_get_buffer2(pContext, pFrame, flags);
+			}
+		}
+
+		buffer = av_buffer_pool_get(pPool);
+	}
+
+	if (!buffer)
+	{
+		return AVERROR(ENOMEM);
+	}
+
+	pFrame->buf[0] = buffer;
+
+	for (int i = 0; i < 4; ++i)
+	{
+		pFrame->data[i] = linesize[i] ? buffer->data + offset[i] : nullptr;
+		pFrame->linesize[i] = linesize[i];
+	}
+
+	pFrame->extended_data = pFrame->data;
+	return 0;
+}
+
+void FramePool::Attach(AVCodecContext* pContext, int count)
+{
+	Free();
+
+	pContext->opaque = this;
+	pContext->get_buffer2 = GetBuffer2;
+
+	if (pContext->pix_fmt == AV_PIX_FMT_NONE || pContext->width <= 0 || pContext->height <= 0)
+	{
+		return;
+	}
+
+	// Grow the pool to the expected number of frames in flight right away
+	AVFrame* pFrame = av_frame_alloc();
+	if (!pFrame)
+	{
+		return;
+	}
+
+	pFrame->format = pContext->pix_fmt;
+	pFrame->width = pContext->width;
+	pFrame->height = pContext->height;
+
+	std::vector<AVBufferRef*> buffers;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (Setup(pContext, pFrame))
+		{
+			for (int i = 0; i < count; ++i)
+			{
+				AVBufferRef* buffer = av_buffer_pool_get(pPool);
+				if (buffer)
+				{
+					buffers.push_back(buffer);
+				}
+			}
+		}
+	}
+
+	for (auto buffer : buffers)
+	{
+		av_buffer_unref(&buffer);
+	}
+
+	av_frame_free(&pFrame);
+}
+
+void FramePool::Free()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (pPool)
+	{
+		av_buffer_pool_uninit(&pPool);
+	}
+
+	format = -1;
+	width = 0;
+	height = 0;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <mutex>
+#include <stddef.h>
+
+extern "C"
+{
+#include "libavcodec/avcodec.h"
+#include "libavutil/buffer.h"
+}
+
+// get_buffer2 allocator that decodes into reusable 64-byte aligned buffers, one per frame.
+// Buffers return to the pool when the last reference to their frame is released, so once
+// the pool has grown to the number of frames in flight playback doesn't allocate frame memory.
+class FramePool
+{
+private:
+	std::mutex mutex;
+	AVBufferPool* pPool = nullptr;
+
+	// Layout of the frames in the pool
+	int format = -1;
+	int width = 0;
+	int height = 0;
+	int linesize[4] = {};
+	size_t offset[4] = {};
+
+	static const int Alignment = 64;
+
+	static AVBufferRef* Alloc(void* opaque, size_t size);
+	static void FreeBuffer(void* opaque, uint8_t* data);
+	static int GetBuffer2(AVCodecContext* pContext, AVFrame* pFrame, int flags);
+
+	bool Setup(AVCodecContext* pContext, const AVFrame* pFrame);
+	int GetBuffer(AVCodecContext* pContext, AVFrame* pFrame, int flags);
+
+public:
+	// Makes the decoder allocate its frames from this pool, count buffers are allocated up front
+	void Attach(AVCodecContext* pContext, int count);
+
+	// Outstanding frames stay valid, their buffers are freed when released
+	void Free();
+
+	~FramePool()
+	{
+		Free();
+	}
+};
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+extern "C"
+{
+#include "libavutil/frame.h"
+#include "libavutil/mem.h"
+}
+
+// Fixed-capacity single-producer/single-consumer ring of preallocated frames.
+// The decoder fills slots at the head, the game thread consumes them from the tail.
+class FrameQueue
+{
+public:
+	static const unsigned int Capacity = 8; // Must be a power of two
+
+	struct Frame
+	{
+		double video_time;
+		unsigned int serial; // Seek generation the frame belongs to
+		uint8_t* data;  // Preallocated output buffer, if the frames are converted
+		AVFrame* frame; // Reference to the decoded frame until it has been converted
+		bool converted; // data holds the converted frame
+	};
+
+private:
+	Frame frames[Capacity] = {};
+	size_t frame_size = 0;
+
+	std::atomic<unsigned int> head{ 0 }; // Written by the producer only
+	std::atomic<unsigned int> tail{ 0 }; // Written by the consumer only
+
+public:
+	bool Allocate(size_t size)
+	{
+		Free();
+
+		for (auto& frame : frames)
+		{
+			frame.frame = av_frame_alloc();
+			if (!frame.frame)
+			{
+				Free();
+				return false;
+			}
+
+			if (size)
+			{
+				// av_malloc returns buffers aligned for SIMD access
+				frame.data = (uint8_t*)av_malloc(size);
+				if (!frame.data)
+				{
+					Free();
+					return false;
+				}
+			}
+		}
+
+		frame_size = size;
+		return true;
+	}
+
+	void Free()
+	{
+		for (auto& frame : frames)
+		{
+			if (frame.data)
+			{
+				av_freep(&frame.data);
+			}
+
+			if (frame.frame)
+			{
+				av_frame_free(&frame.frame);
+			}
+		}
+
+		frame_size = 0;
+		head.store(0);
+		tail.store(0);
+	}
+
+	size_t FrameSize() const
+	{
+		return frame_size;
+	}
+
+	unsigned int Count() const
+	{
+		return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+	}
+
+	// Producer: returns the slot to write into, or nullptr if the queue is full
+	Frame* Back()
+	{
+		unsigned int index = head.load(std::memory_order_relaxed);
+		if (index - tail.load(std::memory_order_acquire) >= Capacity)
+			return nullptr;
+		return &frames[index & (Capacity - 1)];
+	}
+
+	// Producer: publishes the slot returned by Back()
+	void Push()
+	{
+		head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	// Consumer: returns the n-th queued frame, or nullptr if there are not enough frames
+	Frame* Front(unsigned int n = 0)
+	{
+		unsigned int index = tail.load(std::memory_order_relaxed);
+		if (head.load(std::memory_order_acquire) - index <= n)
+			return nullptr;
+		return &frames[(index + n) & (Capacity - 1)];
+	}
+
+	// Consumer: releases the oldest frame back to the producer
+	void Pop()
+	{
+		unsigned int index = tail.load(std::memory_order_relaxed);
+		av_frame_unref(frames[index & (Capacity - 1)].frame);
+		tail.store(index + 1, std::memory_order_release);
+	}
+};
@@ -0,0 +1,176 @@
+#include "media_source.h"
+
+#include <string.h>
+
+extern "C"
+{
+#include "libavutil/error.h"
+#include "libavutil/mem.h"
+}
+
+int MediaSource::ReadPacket(void* opaque, uint8_t* buf, int buf_size)
+{
+	MediaSource* source = (MediaSource*)opaque;
+	int64_t remaining = source->size - source->position;
+
+	if (remaining <= 0)
+	{
+		return AVERROR_EOF;
+	}
+
+	int count = remaining < buf_size ? (int)remaining : buf_size;
+	memcpy(buf, source->data + source->position, count);
+	source->position += count;
+	return count;
+}
+
+int64_t MediaSource::Seek(void* opaque, int64_t offset, int whence)
+{
+	MediaSource* source = (MediaSource*)opaque;
+
+	switch (whence & ~AVSEEK_FORCE)
+	{
+	case AVSEEK_SIZE:
+		return source->size;
+	case SEEK_SET:
+		break;
+	case SEEK_CUR:
+		offset += source->position;
+		break;
+	case SEEK_END:
+		offset += source->size;
+		break;
+	default:
+		return -1;
+	}
+
+	if (offset < 0 || offset > source->size)
+	{
+		return -1;
+	}
+
+	source->position = offset;
+	return offset;
+}
+
+bool MediaSource::CreateContext()
+{
+	uint8_t* buffer = (uint8_t*)av_malloc(BufferSize);
+	if (!buffer)
+	{
+		return false;
+	}
+
+	pContext = avio_alloc_context(buffer, BufferSize, 0, this, ReadPacket, nullptr, Seek);
+	if (!pContext)
+	{
+		av_free(buffer);
+		return false;
+	}
+
+	return true;
+}
+
+bool MediaSource::OpenMemory(const void* buffer, size_t buffer_size)
+{
+	Close();
+
+	if (!buffer)
+	{
+		return false;
+	}
+
+	data = (const uint8_t*)buffer;
+	size = (int64_t)buffer_size;
+	position = 0;
+
+	if (!CreateContext())
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+bool MediaSource::OpenFile(const char* path)
+{
+	Close();
+
+	// FFmpeg paths are UTF-8
+	wchar_t wpath[MAX_PATH];
+	if (!MultiByteToWideChar(CP_UTF8, 0, path, -1, wpath, MAX_PATH))
+	{
+		return false;
+	}
+
+	file = CreateFileW(wpath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0 || (uint64_t)file_size.QuadPart > SIZE_MAX)
+	{
+		Close();
+		return false;
+	}
+
+	mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mapping)
+	{
+		Close();
+		return false;
+	}
+
+	view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!view)
+	{
+		Close();
+		return false;
+	}
+
+	data = (const uint8_t*)view;
+	size = file_size.QuadPart;
+	position = 0;
+
+	if (!CreateContext())
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void MediaSource::Close()
+{
+	if (pContext)
+	{
+		av_freep(&pContext->buffer);
+		avio_context_free(&pContext);
+	}
+
+	if (view)
+	{
+		UnmapViewOfFile(view);
+		view = nullptr;
+	}
+
+	if (mapping)
+	{
+		CloseHandle(mapping);
+		mapping = NULL;
+	}
+
+	if (file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(file);
+		file = INVALID_HANDLE_VALUE;
+	}
+
+	data = nullptr;
+	size = 0;
+	position = 0;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <Windows.h>
+#include <stdint.h>
+
+extern "C"
+{
+#include "libavformat/avio.h"
+}
+
+// Demuxer input that reads from memory: a buffer owned by the caller, or a file mapped into
+// the address space. Reads are served straight from the memory without any file I/O.
+class MediaSource
+{
+private:
+	const uint8_t* data = nullptr;
+	int64_t size = 0;
+	int64_t position = 0;
+
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+	void* view = nullptr;
+
+	AVIOContext* pContext = nullptr;
+
+	static const int BufferSize = 256 * 1024;
+
+	static int ReadPacket(void* opaque, uint8_t* buf, int buf_size);
+	static int64_t Seek(void* opaque, int64_t offset, int whence);
+
+	bool CreateContext();
+
+public:
+	// The buffer has to stay valid until the source is closed
+	bool OpenMemory(const void* buffer, size_t buffer_size);
+
+	// Fails if the file can't be mapped, for example when it doesn't fit into the address space
+	bool OpenFile(const char* path);
+
+	void Close();
+
+	// I/O context for AVFormatContext::pb, or nullptr if the source isn't open
+	AVIOContext* Context()
+	{
+		return pContext;
+	}
+
+	~MediaSource()
+	{
+		Close();
+	}
+};
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <mutex>
+#include <stdint.h>
+
+extern "C"
+{
+#include "libavcodec/packet.h"
+}
+
+// Bounded queue of demuxed packets for one stream, filled by the demuxer and emptied by the
+// stream's decoder. Markers for seeks, loops and the end of the stream travel with the packets
+// so that the decoder applies them in order.
+class PacketQueue
+{
+public:
+	enum Kind
+	{
+		PACKET_DATA,
+		PACKET_SEEK, // Decoder restarts, skips to time and tags its frames with serial
+		PACKET_LOOP, // Decoder drains, then adds time to the timestamps of the next pass
+		PACKET_END,  // Decoder drains and finishes
+	};
+
+	struct Marker
+	{
+		Kind kind;
+		unsigned int serial;
+		double time;
+	};
+
+	static const unsigned int Capacity = 512;   // Must be a power of two
+	static const unsigned int MarkerReserve = 4; // Slots that only markers can use
+
+private:
+	struct Entry
+	{
+		AVPacket* packet;
+		Marker marker;
+		double duration;
+	};
+
+	std::mutex mutex;
+	Entry entries[Capacity] = {};
+	unsigned int head = 0;
+	unsigned int tail = 0;
+
+	size_t bytes = 0;
+	double duration = 0.0;     // Seconds
+	size_t max_bytes = 0;      // Packets are held back by the demuxer above this
+	double max_duration = 0.0; // The demuxer stops reading ahead above this
+	double time_base = 0.0;
+	double default_duration = 0.0; // Used for packets without a duration
+
+public:
+	bool Allocate(size_t max_bytes_, double max_duration_, AVRational time_base_, double default_duration_)
+	{
+		Free();
+
+		for (auto& entry : entries)
+		{
+			entry.packet = av_packet_alloc();
+			if (!entry.packet)
+			{
+				Free();
+				return false;
+			}
+		}
+
+		max_bytes = max_bytes_;
+		max_duration = max_duration_;
+		time_base = av_q2d(time_base_);
+		default_duration = default_duration_;
+		return true;
+	}
+
+	void Free()
+	{
+		for (auto& entry : entries)
+		{
+			if (entry.packet)
+			{
+				av_packet_free(&entry.packet);
+			}
+		}
+
+		head = 0;
+		tail = 0;
+		bytes = 0;
+		duration = 0.0;
+	}
+
+	// Drops everything that is queued
+	void Clear()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for (; tail != head; ++tail)
+		{
+			av_packet_unref(entries[tail & (Capacity - 1)].packet);
+		}
+
+		bytes = 0;
+		duration = 0.0;
+	}
+
+	unsigned int Count()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return head - tail;
+	}
+
+	size_t Bytes()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return bytes;
+	}
+
+	// No more packets fit
+	bool Full()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return head - tail >= Capacity - MarkerReserve || bytes >= max_bytes;
+	}
+
+	// Enough is queued to keep the decoder busy, or no more fits
+	bool Enough()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return head - tail >= Capacity - MarkerReserve || bytes >= max_bytes || duration >= max_duration;
+	}
+
+	// Takes over the packet's reference, fails if the queue is full
+	bool Push(AVPacket* pPacket)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (head - tail >= Capacity - MarkerReserve || bytes >= max_bytes)
+		{
+			return false;
+		}
+
+		Entry& entry = entries[head & (Capacity - 1)];
+		av_packet_move_ref(entry.packet, pPacket);
+		entry.marker = { PACKET_DATA, 0, 0.0 };
+		entry.duration = entry.packet->duration > 0 ? entry.packet->duration * time_base : default_duration;
+
+		bytes += entry.packet->size;
+		duration += entry.duration;
+		++head;
+		return true;
+	}
+
+	bool PushMarker(const Marker& marker)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (head - tail >= Capacity)
+		{
+			return false;
+		}
+
+		Entry& entry = entries[head & (Capacity - 1)];
+		entry.marker = marker;
+		entry.duration = 0.0;
+		++head;
+		return true;
+	}
+
+	// Moves the oldest packet into pPacket, or returns a marker with an empty packet
+	bool Pop(AVPacket* pPacket, Marker& marker)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (head == tail)
+		{
+			return false;
+		}
+
+		Entry& entry = entries[tail & (Capacity - 1)];
+		marker = entry.marker;
+
+		if (marker.kind == PACKET_DATA)
+		{
+			bytes -= entry.packet->size;
+			duration -= entry.duration;
+			av_packet_move_ref(pPacket, entry.packet);
+		}
+
+		++tail;
+
+		if (head == tail)
+		{
+			duration = 0.0;
+		}
+
+		return true;
+	}
+};
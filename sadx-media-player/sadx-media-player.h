@@ -1,11 +1,102 @@
+#pragma once
+
+#include <stddef.h>
+
+// Flags for ffPlayerOpenEx and ffPlayerOptions. A width and height of 0 keep the video size, format is an ffPlayerFormat.
+#define FFPLAYER_OPEN_SFD 0x1 // SFD compatibility mode (ADX audio)
+#define FFPLAYER_OPEN_YUV 0x2 // Keep frames in planar YUV for ffPlayerGetFramePlanes instead of converting to BGRA
+#define FFPLAYER_OPEN_SWSCALE 0x4 // Always convert with swscale instead of the built-in SSE2/AVX2 converter
+#define FFPLAYER_OPEN_SCALE_BILINEAR 0x8 // Bilinear swscale filter instead of bicubic
+#define FFPLAYER_OPEN_SCALE_FAST 0x10 // Fast bilinear swscale filter, lowest quality
+#define FFPLAYER_OPEN_LOOP 0x20 // Restart from the beginning without a gap instead of finishing
+
+// Frame formats
+enum ffPlayerFormat
+{
+	FFPLAYER_FORMAT_BGRA,     // B, G, R, A bytes (D3DFMT_A8R8G8B8)
+	FFPLAYER_FORMAT_BGRX,     // B, G, R bytes and unused fourth byte (D3DFMT_X8R8G8B8)
+	FFPLAYER_FORMAT_RGB565,   // 16 bit little endian (D3DFMT_R5G6B5)
+	FFPLAYER_FORMAT_YUV420P,  // Y, U and V planes, limited range
+	FFPLAYER_FORMAT_YUVJ420P, // Y, U and V planes, full range
+	FFPLAYER_FORMAT_NV12,     // Y plane and interleaved UV plane, limited range
+};
+
+// Decoder threading types for ffPlayerOptions
+#define FFPLAYER_THREAD_FRAME 0x1 // Decode several frames in parallel
+#define FFPLAYER_THREAD_SLICE 0x2 // Decode slices of a frame in parallel
+
+// Options for ffPlayerOpenWithOptions, zero initialized options use the defaults
+struct ffPlayerOptions
+{
+	unsigned int flags;  // FFPLAYER_OPEN_*
+	unsigned int width;  // Output width, 0 keeps the video width
+	unsigned int height; // Output height, 0 keeps the video height
+	int format;          // ffPlayerFormat
+	int thread_count;    // Video decoder threads, 0 picks one per CPU core, 1 disables threading
+	int thread_type;     // FFPLAYER_THREAD_*, 0 allows all types supported by the codec
+};
+
+// Playback statistics for ffPlayerGetStats. Times are in milliseconds, averaged over recent frames
+// or packets, with the maximum since the video was opened.
+struct ffPlayerStats
+{
+	double demux_time;           // Reading a packet
+	double demux_time_max;
+	double decode_time;          // Decoding a video frame
+	double decode_time_max;
+	double convert_time;         // Converting a presented frame
+	double convert_time_max;
+	unsigned int queued_frames;  // Decoded frames waiting to be presented
+	unsigned int presented_frames;
+	unsigned int dropped_frames; // Decoded but never presented, since opening
+	unsigned int skipped_frames; // Skipped by the decoder while it lagged behind
+	unsigned int late_frames;    // Decoded after they were due
+	double audio_buffered;       // Seconds of decoded audio waiting for BASS
+	double av_drift;             // Audio clock minus presentation clock in seconds, as last measured
+};
+
+// Player instance. The functions without a handle use a default instance that always exists.
+struct ffPlayerInstance;
+
 extern "C"
 {
+	__declspec(dllexport) ffPlayerInstance* ffPlayerCreate();
+	__declspec(dllexport) void ffPlayerDestroy(ffPlayerInstance* instance);
+	__declspec(dllexport) void ffPlayerInstancePlay(ffPlayerInstance* instance);
+	__declspec(dllexport) void ffPlayerInstancePause(ffPlayerInstance* instance);
+	__declspec(dllexport) bool ffPlayerInstanceFinished(ffPlayerInstance* instance);
+	__declspec(dllexport) bool ffPlayerInstanceGetStats(ffPlayerInstance* instance, ffPlayerStats* stats);
+	__declspec(dllexport) void ffPlayerInstanceSeek(ffPlayerInstance* instance, double seconds);
+	__declspec(dllexport) bool ffPlayerInstanceOpen(ffPlayerInstance* instance, const char* path, bool sfd);
+	__declspec(dllexport) bool ffPlayerInstanceOpenEx(ffPlayerInstance* instance, const char* path, unsigned int flags, unsigned int width, unsigned int height, int format);
+	__declspec(dllexport) bool ffPlayerInstanceOpenWithOptions(ffPlayerInstance* instance, const char* path, const ffPlayerOptions* options);
+	__declspec(dllexport) bool ffPlayerInstanceOpenMemory(ffPlayerInstance* instance, const void* buf, size_t size, const char* name_hint);
+	__declspec(dllexport) bool ffPlayerInstanceOpenMemoryWithOptions(ffPlayerInstance* instance, const void* buf, size_t size, const char* name_hint, const ffPlayerOptions* options);
+	__declspec(dllexport) void ffPlayerPrefetch(const char* path); // Opens the video in the background, the next open with the same options takes it over
+	__declspec(dllexport) void ffPlayerPrefetchWithOptions(const char* path, const ffPlayerOptions* options);
+	__declspec(dllexport) void ffPlayerInstanceClose(ffPlayerInstance* instance);
+	__declspec(dllexport) bool ffPlayerInstanceGetFrameBuffer(ffPlayerInstance* instance, unsigned char* pBuffer);
+	__declspec(dllexport) bool ffPlayerInstanceAcquireFrame(ffPlayerInstance* instance, const unsigned char** data, int* stride, double* pts);
+	__declspec(dllexport) bool ffPlayerInstanceGetFramePlanes(ffPlayerInstance* instance, const unsigned char** planes, int* strides, int* format, double* pts);
+	__declspec(dllexport) void ffPlayerInstanceReleaseFrame(ffPlayerInstance* instance);
+	__declspec(dllexport) unsigned int ffPlayerInstanceWidth(ffPlayerInstance* instance);
+	__declspec(dllexport) unsigned int ffPlayerInstanceHeight(ffPlayerInstance* instance);
+
 	__declspec(dllexport) void ffPlayerPlay();
 	__declspec(dllexport) void ffPlayerPause();
 	__declspec(dllexport) bool ffPlayerFinished();
+	__declspec(dllexport) bool ffPlayerGetStats(ffPlayerStats* stats);
+	__declspec(dllexport) void ffPlayerSeek(double seconds); // Position in the video, applied asynchronously
 	__declspec(dllexport) bool ffPlayerOpen(const char* path, bool sfd);
+	__declspec(dllexport) bool ffPlayerOpenEx(const char* path, unsigned int flags, unsigned int width, unsigned int height, int format);
+	__declspec(dllexport) bool ffPlayerOpenWithOptions(const char* path, const ffPlayerOptions* options);
+	__declspec(dllexport) bool ffPlayerOpenMemory(const void* buf, size_t size, const char* name_hint); // The buffer has to stay valid until the video is closed
+	__declspec(dllexport) bool ffPlayerOpenMemoryWithOptions(const void* buf, size_t size, const char* name_hint, const ffPlayerOptions* options);
 	__declspec(dllexport) void ffPlayerClose();
 	__declspec(dllexport) bool ffPlayerGetFrameBuffer(unsigned char* pBuffer);
+	__declspec(dllexport) bool ffPlayerAcquireFrame(const unsigned char** data, int* stride, double* pts);
+	__declspec(dllexport) bool ffPlayerGetFramePlanes(const unsigned char** planes, int* strides, int* format, double* pts);
+	__declspec(dllexport) void ffPlayerReleaseFrame();
 	__declspec(dllexport) unsigned int ffPlayerWidth();
 	__declspec(dllexport) unsigned int ffPlayerHeight();
 }
\ No newline at end of file
@@ -1,503 +1,1936 @@
-// TODO: Improve prerendering (ditch vectors, second thread, preallocate buffers)
-
 #include <DShow.h>
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <thread>
 #include <vector>
 #include "bass_vgmstream.h"
 #include "sadx-media-player.h"
+#include "audio_queue.h"
+#include "decoder_pool.h"
+#include "frame_pool.h"
+#include "media_source.h"
+#include "packet_queue.h"
+#include "frame_queue.h"
+#include "yuv_convert.h"
 
 extern "C"
 {
 #include "libavcodec/avcodec.h"
 #include "libavformat/avformat.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/pixdesc.h"
 #include "libswscale/swscale.h"
 #include "libswresample/swresample.h"
 }
 
-char msg[4096];
+static AVPixelFormat ToPixelFormat(int format)
+{
+	switch (format)
+	{
+	case FFPLAYER_FORMAT_BGRX:
+		return AV_PIX_FMT_BGR0;
+	case FFPLAYER_FORMAT_RGB565:
+		return AV_PIX_FMT_RGB565LE;
+	case FFPLAYER_FORMAT_YUV420P:
+		return AV_PIX_FMT_YUV420P;
+	case FFPLAYER_FORMAT_YUVJ420P:
+		return AV_PIX_FMT_YUVJ420P;
+	case FFPLAYER_FORMAT_NV12:
+		return AV_PIX_FMT_NV12;
+	default:
+		return AV_PIX_FMT_BGRA;
+	}
+}
+
+static int FromPixelFormat(AVPixelFormat format)
+{
+	switch (format)
+	{
+	case AV_PIX_FMT_BGRA:
+		return FFPLAYER_FORMAT_BGRA;
+	case AV_PIX_FMT_BGR0:
+		return FFPLAYER_FORMAT_BGRX;
+	case AV_PIX_FMT_RGB565LE:
+		return FFPLAYER_FORMAT_RGB565;
+	case AV_PIX_FMT_YUV420P:
+		return FFPLAYER_FORMAT_YUV420P;
+	case AV_PIX_FMT_YUVJ420P:
+		return FFPLAYER_FORMAT_YUVJ420P;
+	case AV_PIX_FMT_NV12:
+		return FFPLAYER_FORMAT_NV12;
+	default:
+		return -1;
+	}
+}
 
+// Playback runs as three tasks on the shared decoder pool: the demuxer reads ahead into a packet
+// queue per stream, and the video and audio decoders each empty their own queue. A run never
+// blocks: whatever doesn't fit into the next queue is kept pending until it has been consumed.
 class VideoPlayer
 {
 private:
-	std::thread* pVideoThread = nullptr;
+	// Forwards pool runs to one of the player's tasks
+	class Task : public DecoderJob
+	{
+	private:
+		VideoPlayer* player;
+		bool (VideoPlayer::*run)(std::chrono::steady_clock::time_point& deadline);
+
+	public:
+		Task(VideoPlayer* player, bool (VideoPlayer::*run)(std::chrono::steady_clock::time_point& deadline)) : player(player), run(run)
+		{
+		}
+
+		bool Run(std::chrono::steady_clock::time_point& deadline) override
+		{
+			return (player->*run)(deadline);
+		}
+	};
+
+	// Decoding state of one stream, only touched by its decoder task once opened
+	struct Stream
+	{
+		int index = -1;
+		AVCodecContext* pCodecContext = nullptr;
+		PacketQueue packets;
+		AVPacket* pPacket = nullptr;   // Packet popped from the queue
+		PacketQueue::Marker marker = {}; // Loop or end marker being drained
+		bool draining = false;           // The decoder is being drained for the marker
+		bool flushed = false;            // The end of stream has been sent to the decoder
+		bool decoder_end = false;        // The decoder returned all of its frames
+		unsigned int serial = 0;         // Serial of the frames being decoded
+		double time_offset = 0.0;        // Added to media time so that the clock keeps running across loops
+		double skip_until = 0.0;         // Decoded frames that end before this media time are dropped
+		std::atomic<bool> done{ false }; // Everything has been decoded and queued
+	};
+
+	DecoderPool& pool;
+	Task demux_task{ this, &VideoPlayer::RunDemux };
+	Task video_task{ this, &VideoPlayer::RunVideo };
+	Task audio_task{ this, &VideoPlayer::RunAudio };
 
+	MediaSource source;
 	AVFormatContext* pFormatContext = nullptr;
 	AVPacket* pPacket = nullptr;
-	AVFrame* pFrame = nullptr;
+	bool packet_pending = false; // pPacket was read but its queue is full
 
-	AVCodecContext* pVideoCodecContext = nullptr;
+	Stream video;
+	AVFrame* pFrame = nullptr;
+	FramePool frame_pool;
+	bool frame_pending = false; // pFrame was decoded but the frame queue was full
 	SwsContext* pSwsContext = nullptr;
-	AVFrame* pVideoFrame = nullptr;
-	uint8_t* framebuffer = nullptr;
-
-	AVCodecContext* pAudioCodecContext = nullptr;
-	SwrContext* pSwrContext = nullptr;
+	FrameQueue video_frames;
+	AVPixelFormat output_format = AV_PIX_FMT_BGRA;
+	bool planar = false;
+	bool passthrough = false; // Decoded frames are presented as they are instead of being converted
+	bool yuv_convert = false; // Frames are converted with the built-in converter instead of swscale
+	YuvLayout yuv_layout = YUV_LAYOUT_I420;
+	bool yuv_full_range = false;
+
+	Stream audio;
 	AVFrame* pAudioFrame = nullptr;
+	SwrContext* pSwrContext = nullptr;
+	AudioQueue audio_samples;
+	float* audio_buffer = nullptr;     // Resampler output
+	int audio_buffer_size = 0;         // Samples per channel
+	unsigned int audio_pending = 0;    // Frames in audio_buffer that didn't fit into the queue yet
+	unsigned int audio_pending_offset = 0;
+	int audio_channels = 0;
 	HSTREAM BassHandle = NULL;
 
-	int video_stream_index = -1;
-	int audio_stream_index = -1;
-
-	unsigned int width = 0;
+	unsigned int width = 0;  // Output size, may differ from the decoded size
 	unsigned int height = 0;
 
-	bool opened = false;
-	bool play = false;
-	bool finished = false;
-	bool update = false;
+	std::atomic<bool> opened{ false };
+	std::atomic<bool> play{ false };
+	bool leased = false; // Front frame is held by the caller, only accessed by the game thread
 
-	std::chrono::steady_clock::time_point real_time;
-	double video_time = 0.0;
-	double next = 0.0;
+	// Presentation clock in seconds. It runs on the system clock from the last anchor and
+	// is slaved to the audio clock (BASS playback position) whenever audio is playing.
+	std::mutex clock_mutex;
+	std::chrono::steady_clock::time_point clock_real;
+	double clock_time = 0.0;
+	double audio_start_time = 0.0;
+	bool audio_started = false;
 
-	struct Frame
+	// Video keyframes in pts order, taken from the demuxer index and added while reading
+	struct KeyFrame
 	{
-		double video_time;
-		uint8_t* data;
-		size_t size;
+		int64_t pts;
+		int64_t pos;
 	};
 
-	std::vector<Frame> video_frames;
+	std::vector<KeyFrame> keyframes;
+
+	// Seek requested by the game thread, applied by the demuxer and passed on to the decoders
+	std::mutex seek_mutex;
+	double seek_time = 0.0;
+	bool seek_requested = false;
+	std::atomic<unsigned int> serial{ 0 }; // Bumped by every seek, queued frames of an older serial are discarded
+
+	bool loop = false;
+	double loop_start = 0.0;  // Media time a loop restarts from
+	double pass_end = 0.0;    // End of the last packet of this pass, audio leads if there is any
+	bool end_of_file = false; // The end marker has been queued
+
+	// Decoder frame skipping, raised while decoded frames arrive late and lowered once they are on time again
+	int skip_level = 0;       // Index into SkipDiscard
+	int late_run = 0;         // Consecutive late (positive) or on-time (negative) frames
+	double last_frame_end = 0.0;
+	std::atomic<unsigned int> dropped_frames{ 0 }; // Decoded but never presented
+	std::atomic<unsigned int> skipped_frames{ 0 }; // Not decoded at all, estimated from timestamp gaps
+
+	// Statistics for ffPlayerGetStats. Times are smoothed per frame or packet, in milliseconds.
+	std::mutex stats_mutex;
+	ffPlayerStats stats = {};
+	double decode_time = 0.0; // Decoder time spent since the last decoded video frame
+	std::atomic<unsigned int> late_frames{ 0 };
+	std::atomic<unsigned int> presented_frames{ 0 };
+	double av_drift = 0.0;    // Protected by clock_mutex
+
+	static constexpr double SyncResetThreshold = 1.0; // Drift above which the clock jumps to the audio position
+	static constexpr double SyncTimeConstant = 0.5;   // Time over which smaller drift is corrected
+	static constexpr double LateThreshold = 0.1;      // Frames later than this are dropped before conversion
+	static constexpr int SyncInterval = 50;           // Maximum sleep in milliseconds while playing
+	static constexpr int MaxAutoThreads = 8;          // Decoder thread limit when the thread count is automatic
+	static constexpr double AudioBufferLength = 1.0;  // Seconds of decoded audio that can be queued
+	static constexpr double ReadAhead = 2.0;          // Seconds of packets the demuxer queues per stream
+	static constexpr size_t VideoQueueBytes = 8 << 20; // Limits of the packet queues, in case durations are missing
+	static constexpr size_t AudioQueueBytes = 1 << 20;
+	static constexpr int SkipRaiseCount = 4;          // Late frames in a row before the decoder skips more
+	static constexpr int SkipLowerCount = 16;         // On-time frames in a row before the decoder skips less
+	static constexpr double StatsSmoothing = 0.1;     // Weight of the newest sample in the averaged times
+
+	// Schedules a run of the task, after its input or output has been consumed or playback state changed
+	void Wake(Task& task)
+	{
+		pool.Wake(&task);
+	}
 
-	void DecodeAudio(AVStream* pStream)
+	void WakeAll()
 	{
-		if (avcodec_send_packet(pAudioCodecContext, pPacket) < 0)
-		{
-			return;
-		}
+		pool.Wake(&demux_task);
+		pool.Wake(&video_task);
+		pool.Wake(&audio_task);
+	}
 
-		if (avcodec_receive_frame(pAudioCodecContext, pFrame) < 0)
+	// How long a task that waits for the game or BASS sleeps before checking again
+	void SleepDeadline(std::chrono::steady_clock::time_point& deadline)
+	{
+		if (play && !Decoded())
 		{
-			return;
+			deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(SyncInterval);
 		}
+	}
 
-		if (swr_convert_frame(pSwrContext, pAudioFrame, pFrame) < 0)
-		{
-			OutputDebugStringA("[video] Failed to convert audio frame.\n");
-			return;
-		}
+	// Everything has been decoded and queued
+	bool Decoded()
+	{
+		return video.done && (audio.index < 0 || audio.done);
+	}
 
-		int size = av_samples_get_buffer_size(&pAudioFrame->linesize[0], pAudioFrame->ch_layout.nb_channels, pAudioFrame->nb_samples, AV_SAMPLE_FMT_FLT, 0);
-		if (size < 0)
+	double ClockLocked(std::chrono::steady_clock::time_point now)
+	{
+		if (!play)
 		{
-			OutputDebugStringA("[video] Failed to send audio buffer to BASS.\n");
-			return;
+			return clock_time;
 		}
 
-		BASS_StreamPutData(BassHandle, pAudioFrame->data[0], size);
+		return clock_time + std::chrono::duration_cast<std::chrono::microseconds>(now - clock_real).count() / 1000000.0;
+	}
+
+	double Clock()
+	{
+		std::lock_guard<std::mutex> lock(clock_mutex);
+		return ClockLocked(std::chrono::steady_clock::now());
 	}
 
-	void DecodeVideo(AVStream* pStream)
+	bool GetAudioClock(double& time)
 	{
-		if (avcodec_send_packet(pVideoCodecContext, pPacket) < 0)
+		if (!BassHandle || !audio_started || BASS_ChannelIsActive(BassHandle) != BASS_ACTIVE_PLAYING)
 		{
-			return;
+			return false;
 		}
 
-		if (avcodec_receive_frame(pVideoCodecContext, pFrame) < 0)
+		QWORD pos = BASS_ChannelGetPosition(BassHandle, BASS_POS_BYTE);
+		if (pos == (QWORD)-1)
 		{
-			return;
+			return false;
 		}
 
-		sws_scale(pSwsContext,
-			pFrame->data,
-			pFrame->linesize,
-			0,
-			pFrame->height,
-			pVideoFrame->data,
-			pVideoFrame->linesize);
-
-		size_t size = width * height * 4;
-		auto data = (uint8_t*)malloc(size);
-		memcpy(data, pVideoFrame->data[0], size);
-
-		Frame frame;
-		frame.video_time = pFrame->best_effort_timestamp * av_q2d(pStream->time_base);
-		frame.size = size;
-		frame.data = data;
-
-		video_frames.push_back(frame);
+		time = audio_start_time + BASS_ChannelBytes2Seconds(BassHandle, pos);
+		return true;
 	}
 
-	void Decode()
+	void UpdateClock()
 	{
-		// Queue frames
-		if (video_frames.size() < 5)
-		{
-			int ret = av_read_frame(pFormatContext, pPacket);
+		auto now = std::chrono::steady_clock::now();
+		std::lock_guard<std::mutex> lock(clock_mutex);
 
-			if (ret < 0)
-			{
-				if (ret == AVERROR_EOF)
-				{
-					finished = true; // TODO: wait until queue has been rendered
-				}
-			}
+		double elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - clock_real).count() / 1000000.0;
+		double time = ClockLocked(now);
+		double audio_time;
 
-			if (pPacket->stream_index == video_stream_index)
-			{
-				DecodeVideo(pFormatContext->streams[video_stream_index]);
-			}
-			else if (pPacket->stream_index == audio_stream_index)
+		if (play && GetAudioClock(audio_time))
+		{
+			double drift = audio_time - time;
+			av_drift = drift;
+
+			if (fabs(drift) > SyncResetThreshold)
 			{
-				DecodeAudio(pFormatContext->streams[audio_stream_index]);
+				time = audio_time;
 			}
-
-			av_packet_unref(pPacket);
-		}
-
-		// Run video (TODO: different thread)
-		if (video_frames.size())
-		{
-			if (video_time >= video_frames[0].video_time)
+			else
 			{
-				update = false;
-				memcpy(framebuffer, video_frames[0].data, video_frames[0].size);
-				update = true;
-
-				free(video_frames[0].data);
-				video_frames.erase(video_frames.begin());
+				time += drift * fmin(1.0, elapsed / SyncTimeConstant);
 			}
 		}
-	}
-
-	void m_VideoThread()
-	{
-		while (1)
-		{
-			auto now = std::chrono::steady_clock::now();
-			auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - real_time);
-
-			if (!opened)
-				break;
-
-			if (elapsed.count() == 0)
-				continue;
-
-			real_time = now;
 
-			if (!play || finished)
-				continue;
-
-			video_time += (double)elapsed.count() * 0.90;
-
-			Decode();
-		}
+		clock_time = time;
+		clock_real = now;
 	}
 
-	static void VideoThread(VideoPlayer* _this)
+	static double Milliseconds(std::chrono::steady_clock::duration duration)
 	{
-		_this->m_VideoThread();
+		return std::chrono::duration<double, std::milli>(duration).count();
 	}
 
-public:
-	unsigned int Width()
+	void AddSample(double& average, double& peak, double sample)
 	{
-		return width;
+		std::lock_guard<std::mutex> lock(stats_mutex);
+		average += (sample - average) * StatsSmoothing;
+		peak = fmax(peak, sample);
 	}
 
-	unsigned int Height()
+	// Called by BASS whenever the audio stream needs data
+	static DWORD CALLBACK AudioStreamProc(HSTREAM handle, void* buffer, DWORD length, void* user)
 	{
-		return height;
+		return ((VideoPlayer*)user)->m_AudioStreamProc(buffer, length);
 	}
 
-	bool Finished()
+	DWORD m_AudioStreamProc(void* buffer, DWORD length)
 	{
-		return finished;
-	}
+		unsigned int frame_size = audio_channels * sizeof(float);
+		unsigned int count = audio_samples.Read((float*)buffer, length / frame_size);
 
-	bool GetFrameBuffer(uint8_t* pBuffer)
-	{
-		if (opened && update)
+		if (count == 0 && audio.done)
 		{
-			memcpy(pBuffer, framebuffer, width * height * 4);
-			update = false;
-			return true;
+			return BASS_STREAMPROC_END;
 		}
-		return false;
+
+		return count * frame_size;
 	}
 
-	void Play()
+	void AddKeyFrame(int64_t pts, int64_t pos)
 	{
-		play = true;
-		if (BassHandle)
+		if (keyframes.empty() || keyframes.back().pts < pts)
 		{
-			BASS_ChannelPlay(BassHandle, FALSE);
+			keyframes.push_back({ pts, pos });
+			return;
 		}
-	}
 
-	void Pause()
-	{
-		play = false;
-		if (BassHandle)
+		// Already indexed, or read again after seeking back
+		auto it = std::lower_bound(keyframes.begin(), keyframes.end(), pts, [](const KeyFrame& key, int64_t value) { return key.pts < value; });
+		if (it->pts != pts)
 		{
-			BASS_ChannelStop(BassHandle);
+			keyframes.insert(it, { pts, pos });
 		}
 	}
 
-	bool Open(const char* path, bool sfd)
+	// Positions the demuxer on the last keyframe at or before the given media time
+	bool SeekDemuxer(double time)
 	{
-		if (opened)
+		AVStream* pStream = pFormatContext->streams[video.index];
+		int64_t ts = llrint(time / av_q2d(pStream->time_base));
+
+		auto it = std::upper_bound(keyframes.begin(), keyframes.end(), ts, [](int64_t value, const KeyFrame& key) { return value < key.pts; });
+
+		// Inside the indexed range the keyframe is known and can be jumped to directly
+		if (it != keyframes.begin() && it != keyframes.end())
 		{
-			Close();
+			const KeyFrame& key = *(it - 1);
+
+			// Timestamp seeks in program streams search the file, the byte position doesn't
+			if (key.pos >= 0 && (pFormatContext->iformat->flags & AVFMT_TS_DISCONT) &&
+				av_seek_frame(pFormatContext, video.index, key.pos, AVSEEK_FLAG_BYTE) >= 0)
+			{
+				return true;
+			}
+
+			if (avformat_seek_file(pFormatContext, video.index, key.pts, key.pts, key.pts, 0) >= 0)
+			{
+				return true;
+			}
 		}
 
-		pFormatContext = avformat_alloc_context();
-		if (!pFormatContext)
+		if (avformat_seek_file(pFormatContext, video.index, INT64_MIN, ts, ts, 0) < 0)
 		{
-			OutputDebugStringA("[video] Failed to initialize ffmpeg.\n");
+			OutputDebugStringA("[video] Failed to seek.\n");
 			return false;
 		}
 
-		if (sfd)
+		return true;
+	}
+
+	// Queues a marker for both decoders
+	void PushMarker(const PacketQueue::Marker& marker)
+	{
+		if (!video.packets.PushMarker(marker) || (audio.index >= 0 && !audio.packets.PushMarker(marker)))
 		{
-			OutputDebugStringA("[video] SFD compatibility mode.\n");
-			pFormatContext->audio_codec_id = AV_CODEC_ID_ADPCM_ADX;
+			OutputDebugStringA("[video] Failed to queue stream marker.\n");
 		}
 
-		if (avformat_open_input(&pFormatContext, path, NULL, NULL) != 0 ||
-			avformat_find_stream_info(pFormatContext, NULL) < 0)
+		Wake(video_task);
+		Wake(audio_task);
+	}
+
+	void ApplySeek()
+	{
+		double time;
+		unsigned int seek_serial;
+
 		{
-			sprintf(msg, "[video] Failed to open % s.\n", path);
-			OutputDebugStringA(msg);
-			return false;
+			std::lock_guard<std::mutex> lock(seek_mutex);
+			if (!seek_requested)
+			{
+				return;
+			}
+
+			time = seek_time;
+			seek_serial = serial;
+			seek_requested = false;
 		}
 
-		avio_seek(pFormatContext->pb, 0, SEEK_SET);
+		SeekDemuxer(time);
 
-		video_stream_index = av_find_best_stream(pFormatContext, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
-		if (video_stream_index < 0)
+		if (packet_pending)
 		{
-			OutputDebugStringA("[video] No video stream found.\n");
-			return false;
+			av_packet_unref(pPacket);
+			packet_pending = false;
 		}
 
-		const AVCodec* pVideoCodec = avcodec_find_decoder(pFormatContext->streams[video_stream_index]->codecpar->codec_id);
-		pFormatContext->video_codec = pVideoCodec;
+		end_of_file = false;
+		pass_end = time;
+
+		video.packets.Clear();
+		audio.packets.Clear();
+		PushMarker({ PacketQueue::PACKET_SEEK, seek_serial, time });
+
+		// The audio clock is ignored until audio of the new position is playing
+		std::lock_guard<std::mutex> lock(clock_mutex);
+		clock_time = time;
+		clock_real = std::chrono::steady_clock::now();
+		audio_started = false;
+	}
+
+	// Hands the read packet to the queue of its stream, returns false while that queue is full
+	bool PushPacket()
+	{
+		Stream& stream = pPacket->stream_index == video.index ? video : audio;
 
-		pVideoCodecContext = avcodec_alloc_context3(pVideoCodec);
-		if (!pVideoCodecContext)
+		if (!stream.packets.Push(pPacket))
 		{
-			OutputDebugStringA("[video] Failed to initialize video codec context.\n");
 			return false;
 		}
 
-		AVStream* pVideoStream = pFormatContext->streams[video_stream_index];
+		packet_pending = false;
+		Wake(&stream == &video ? video_task : audio_task);
+		return true;
+	}
 
-		avformat_seek_file(pFormatContext, 0, 0, 0, pFormatContext->streams[0]->duration, 0);
+	void ReadPacket()
+	{
+		auto start = std::chrono::steady_clock::now();
+		int ret = av_read_frame(pFormatContext, pPacket);
+		AddSample(stats.demux_time, stats.demux_time_max, Milliseconds(std::chrono::steady_clock::now() - start));
 
-		if (avcodec_parameters_to_context(pVideoCodecContext, pVideoStream->codecpar) < 0 ||
-			avcodec_open2(pVideoCodecContext, pVideoCodec, NULL) < 0)
+		if (ret < 0)
 		{
-			OutputDebugStringA("[video] Failed to initialize video codec.\n");
-			return false;
+			if (ret == AVERROR_EOF)
+			{
+				EndOfFile();
+			}
+
+			return;
 		}
 
-		width = pVideoCodecContext->width;
-		height = pVideoCodecContext->height;
+		if (pPacket->stream_index != video.index && pPacket->stream_index != audio.index)
+		{
+			av_packet_unref(pPacket);
+			return;
+		}
 
-		pSwsContext = sws_getContext(
-			pVideoCodecContext->width,
-			pVideoCodecContext->height,
-			pVideoCodecContext->pix_fmt,
-			width,
-			height,
-			AV_PIX_FMT_BGRA,
-			SWS_BICUBIC,
-			NULL,
-			NULL,
-			NULL);
+		AVStream* pStream = pFormatContext->streams[pPacket->stream_index];
+		int64_t pts = pPacket->pts != AV_NOPTS_VALUE ? pPacket->pts : pPacket->dts;
 
-		if (pSwsContext == NULL)
+		if (pPacket->stream_index == video.index && (pPacket->flags & AV_PKT_FLAG_KEY) && pPacket->pts != AV_NOPTS_VALUE)
 		{
-			OutputDebugStringA("[video] Failed to initialize video conversion.\n");
-			return false;
+			AddKeyFrame(pPacket->pts, pPacket->pos);
 		}
 
-		pPacket = av_packet_alloc();
-		if (!pPacket)
+		// Audio leads the loop length so that it stays gapless
+		if (pts != AV_NOPTS_VALUE && pPacket->stream_index == (audio.index >= 0 ? audio.index : video.index))
 		{
-			OutputDebugStringA("[video] Failed to allocate packet\n");
-			return false;
+			double duration = pPacket->duration * av_q2d(pStream->time_base);
+
+			if (duration <= 0.0 && pStream->avg_frame_rate.num)
+			{
+				duration = av_q2d(av_inv_q(pStream->avg_frame_rate));
+			}
+
+			pass_end = fmax(pass_end, pts * av_q2d(pStream->time_base) + duration);
 		}
 
-		pFrame = av_frame_alloc();
-		if (!pFrame)
+		packet_pending = true;
+		PushPacket();
+	}
+
+	// Loops back to the start, or lets the decoders finish
+	void EndOfFile()
+	{
+		if (loop)
 		{
-			OutputDebugStringA("[video] Failed to allocate packet frame.\n");
-			return false;
+			PushMarker({ PacketQueue::PACKET_LOOP, 0, fmax(pass_end - loop_start, 0.0) });
+			SeekDemuxer(loop_start);
+			pass_end = loop_start;
 		}
+		else
+		{
+			PushMarker({ PacketQueue::PACKET_END, 0, 0.0 });
+			end_of_file = true;
+		}
+	}
 
-		pVideoFrame = av_frame_alloc();
-		if (!pVideoFrame)
+	bool RunDemux(std::chrono::steady_clock::time_point& deadline)
+	{
+		if (!opened)
 		{
-			OutputDebugStringA("[video] Failed to allocate video output frame.\n");
 			return false;
 		}
 
-		pVideoFrame->format = AV_PIX_FMT_BGRA;
-		pVideoFrame->width = width;
-		pVideoFrame->height = height;
+		ApplySeek();
 
-		if (av_frame_get_buffer(pVideoFrame, 0) < 0)
+		// Nothing left to read until the next seek
+		if (end_of_file)
 		{
-			OutputDebugStringA("[video] Failed to allocate video output frame buffer.\n");
 			return false;
 		}
 
-		framebuffer = (uint8_t*)av_malloc(width * height * 4);
-		if (!framebuffer)
+		// Woken by the decoder once its queue has room
+		if (packet_pending && !PushPacket())
 		{
-			OutputDebugStringA("[video] Failed to allocate frame buffer.\n");
 			return false;
 		}
 
-		audio_stream_index = av_find_best_stream(pFormatContext, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
-		if (audio_stream_index >= 0)
+		// Read ahead until every stream has enough queued
+		if (video.packets.Enough() && (audio.index < 0 || audio.packets.Enough()))
 		{
-			const AVCodec* pAudioCodec = avcodec_find_decoder(pFormatContext->streams[audio_stream_index]->codecpar->codec_id);
-			pFormatContext->audio_codec = pAudioCodec;
+			return false;
+		}
 
-			pAudioCodecContext = avcodec_alloc_context3(pAudioCodec);
-			if (!pAudioCodecContext)
-			{
-				OutputDebugStringA("[video] Failed to initialize audio codec context.\n");
-				return false;
-			}
+		ReadPacket();
+		return true;
+	}
 
-			AVStream* pAudioStream = pFormatContext->streams[audio_stream_index];
+	// Runs one step of a stream decoder: hands it the next queued packet, or applies the next marker.
+	// drain moves decoded frames on and returns false while there's no room for them.
+	// Returns true if there is more to do right away.
+	bool StepDecoder(Stream& stream, bool (VideoPlayer::*drain)(), void (VideoPlayer::*reset)(double time))
+	{
+		// The decoder only takes more input once its output has been drained
+		if (!(this->*drain)())
+		{
+			return false;
+		}
 
-			if (avcodec_parameters_to_context(pAudioCodecContext, pAudioStream->codecpar) < 0 ||
-				avcodec_open2(pAudioCodecContext, pAudioCodec, NULL) < 0)
+		if (stream.draining)
+		{
+			if (!stream.flushed)
 			{
-				OutputDebugStringA("[video] failed to initialize audio codec.\n");
-				return false;
+				avcodec_send_packet(stream.pCodecContext, nullptr);
+				stream.flushed = true;
+				return true;
 			}
 
-			// Initialize resampler
-			if (swr_alloc_set_opts2(&pSwrContext, &pAudioCodecContext->ch_layout, AV_SAMPLE_FMT_FLT, pAudioCodecContext->sample_rate,
-				&pAudioCodecContext->ch_layout, (AVSampleFormat)pAudioStream->codecpar->format, pAudioStream->codecpar->sample_rate, 0, nullptr) < 0)
+			if (!stream.decoder_end)
 			{
-				OutputDebugStringA("[video] Failed to initialize audio conversion.\n");
-				return false;
+				return true;
 			}
 
-			// Force set audio channel layout for SFD
-			if (sfd)
-			{
-				pAudioCodecContext->ch_layout.order = AV_CHANNEL_ORDER_NATIVE;
-				pAudioCodecContext->ch_layout.u.mask = AV_CH_FRONT_LEFT | AV_CH_FRONT_RIGHT;
-			}
+			avcodec_flush_buffers(stream.pCodecContext);
+			stream.draining = false;
+			stream.flushed = false;
+			stream.decoder_end = false;
 
-			pAudioFrame = av_frame_alloc();
-			if (!pAudioFrame)
+			if (stream.marker.kind == PacketQueue::PACKET_END)
 			{
-				OutputDebugStringA("[video] Failed to allocate audio output frame.\n");
+				stream.done = true;
 				return false;
 			}
 
-			pAudioFrame->sample_rate = pAudioCodecContext->sample_rate;
-			pAudioFrame->ch_layout = pAudioCodecContext->ch_layout;
-			pAudioFrame->format = AV_SAMPLE_FMT_FLT;
+			// Continue with the next pass without a gap
+			stream.time_offset += stream.marker.time;
+			return true;
+		}
 
-			BassHandle = BASS_StreamCreate(pAudioCodecContext->sample_rate, pAudioCodecContext->ch_layout.nb_channels, BASS_SAMPLE_FLOAT, STREAMPROC_PUSH, NULL);
-			if (!BassHandle)
+		PacketQueue::Marker marker;
+		if (!stream.packets.Pop(stream.pPacket, marker))
+		{
+			return false;
+		}
+
+		if (!stream.packets.Enough())
+		{
+			Wake(demux_task);
+		}
+
+		switch (marker.kind)
+		{
+		case PacketQueue::PACKET_DATA:
+			if (&stream == &video)
 			{
-				OutputDebugStringA("[video] Failed to initialize audio library.");
-				return false;
+				auto start = std::chrono::steady_clock::now();
+				avcodec_send_packet(stream.pCodecContext, stream.pPacket);
+				decode_time += Milliseconds(std::chrono::steady_clock::now() - start);
+			}
+			else
+			{
+				avcodec_send_packet(stream.pCodecContext, stream.pPacket);
 			}
 
-			BASS_ChannelPlay(BassHandle, FALSE);
+			av_packet_unref(stream.pPacket);
+			break;
+
+		case PacketQueue::PACKET_SEEK:
+			avcodec_flush_buffers(stream.pCodecContext);
+			stream.draining = false;
+			stream.flushed = false;
+			stream.decoder_end = false;
+			stream.serial = marker.serial;
+			stream.time_offset = 0.0;
+			stream.skip_until = marker.time;
+			stream.done = false;
+			(this->*reset)(marker.time);
+			break;
+
+		default:
+			stream.marker = marker;
+			stream.draining = true;
+			break;
 		}
 
-		video_time = pVideoStream->start_time * av_q2d(pVideoStream->time_base);
-		opened = true;
-
-		real_time = std::chrono::steady_clock::now();
-		pVideoThread = new std::thread(VideoThread, this);
 		return true;
 	}
 
-	void Close()
+	void ConvertAudio(AVStream* pStream)
 	{
-		if (opened)
+		if (pAudioFrame->best_effort_timestamp != AV_NOPTS_VALUE)
 		{
-			play = false;
-			opened = false;
-			finished = false;
+			double frame_time = pAudioFrame->best_effort_timestamp * av_q2d(pStream->time_base);
+			double frame_end = frame_time + (double)pAudioFrame->nb_samples / pAudioFrame->sample_rate;
 
-			if (pVideoThread)
+			if (frame_end <= audio.skip_until)
 			{
-				pVideoThread->join();
-				delete pVideoThread;
-				pVideoThread = nullptr;
+				return;
 			}
 
-			if (pFormatContext) avformat_close_input(&pFormatContext);
-			if (pPacket) av_packet_free(&pPacket);
-			if (pFrame) av_frame_free(&pFrame);
+			// Frames decoded before a seek was passed on must not move the audio clock
+			std::lock_guard<std::mutex> lock(clock_mutex);
+			if (!audio_started && audio.serial == serial)
+			{
+				audio_start_time = frame_time + audio.time_offset;
+				audio_started = true;
+			}
+		}
 
-			if (pVideoCodecContext) avcodec_free_context(&pVideoCodecContext);
-			if (pSwsContext) sws_freeContext(pSwsContext);
-			if (pVideoFrame) av_frame_free(&pVideoFrame);
-			if (framebuffer) av_free(framebuffer);
+		int out_samples = swr_get_out_samples(pSwrContext, pAudioFrame->nb_samples);
+		if (out_samples > audio_buffer_size)
+		{
+			av_freep(&audio_buffer);
+			audio_buffer = (float*)av_malloc_array(out_samples, audio_channels * sizeof(float));
+			audio_buffer_size = audio_buffer ? out_samples : 0;
+		}
 
-			if (pAudioCodecContext) avcodec_free_context(&pAudioCodecContext);
-			if (pSwrContext) swr_free(&pSwrContext);
-			if (pAudioFrame) av_frame_free(&pAudioFrame);
-			if (BassHandle) { BASS_StreamFree(BassHandle); BassHandle = NULL; };
+		uint8_t* out = (uint8_t*)audio_buffer;
+		int converted = swr_convert(pSwrContext, &out, audio_buffer_size, (const uint8_t**)pAudioFrame->extended_data, pAudioFrame->nb_samples);
+		if (converted < 0)
+		{
+			OutputDebugStringA("[video] Failed to convert audio frame.\n");
+			return;
 		}
+
+		audio_pending = converted;
+		audio_pending_offset = 0;
 	}
 
-	VideoPlayer() = default;
-	~VideoPlayer()
+	// Moves decoded audio into the sample queue, returns false while the queue is full
+	bool DrainAudio()
 	{
-		Close();
-	}
-};
+		while (true)
+		{
+			if (audio_pending)
+			{
+				unsigned int written = audio_samples.Write(audio_buffer + audio_pending_offset * audio_channels, audio_pending);
+				audio_pending_offset += written;
+				audio_pending -= written;
 
-static VideoPlayer player;
+				if (audio_pending)
+				{
+					return false;
+				}
+			}
 
-extern "C"
-{
-	__declspec(dllexport) void ffPlayerPlay()
-	{
-		return player.Play();
+			// A packet can contain several frames
+			int ret = avcodec_receive_frame(audio.pCodecContext, pAudioFrame);
+			if (ret < 0)
+			{
+				audio.decoder_end = ret == AVERROR_EOF;
+				return true;
+			}
+
+			ConvertAudio(pFormatContext->streams[audio.index]);
+		}
 	}
 
-	__declspec(dllexport) void ffPlayerPause()
+	void ResetAudio(double time)
 	{
-		return player.Pause();
-	}
+		audio_pending = 0;
+
+		// Resetting the position of a user stream clears its playback buffer
+		swr_close(pSwrContext);
+		swr_init(pSwrContext);
+		audio_samples.Discard();
+		BASS_ChannelSetPosition(BassHandle, 0, BASS_POS_BYTE);
+
+		// The stream may have ended already
+		if (play)
+		{
+			BASS_ChannelPlay(BassHandle, FALSE);
+		}
+	}
+
+	bool RunAudio(std::chrono::steady_clock::time_point& deadline)
+	{
+		if (!opened)
+		{
+			return false;
+		}
+
+		if (StepDecoder(audio, &VideoPlayer::DrainAudio, &VideoPlayer::ResetAudio))
+		{
+			return true;
+		}
+
+		// BASS doesn't signal when it has read from the sample queue
+		SleepDeadline(deadline);
+		return false;
+	}
+
+	// Moves decoded video into the frame queue, returns false while the queue is full
+	bool DrainVideo()
+	{
+		while (true)
+		{
+			if (frame_pending)
+			{
+				if (!video_frames.Back())
+				{
+					return false;
+				}
+
+				QueueVideo(pFormatContext->streams[video.index]);
+				av_frame_unref(pFrame);
+				frame_pending = false;
+			}
+
+			auto start = std::chrono::steady_clock::now();
+			int ret = avcodec_receive_frame(video.pCodecContext, pFrame);
+			decode_time += Milliseconds(std::chrono::steady_clock::now() - start);
+
+			if (ret < 0)
+			{
+				video.decoder_end = ret == AVERROR_EOF;
+				return true;
+			}
+
+			AddSample(stats.decode_time, stats.decode_time_max, decode_time);
+			decode_time = 0.0;
+
+			frame_pending = true;
+		}
+	}
+
+	void UpdateSkipLevel(bool late)
+	{
+		static const AVDiscard SkipDiscard[] = { AVDISCARD_DEFAULT, AVDISCARD_NONREF, AVDISCARD_NONKEY };
+
+		if (late)
+		{
+			late_run = late_run > 0 ? late_run + 1 : 1;
+		}
+		else
+		{
+			late_run = late_run < 0 ? late_run - 1 : -1;
+		}
+
+		// Only keyframes are decoded at the highest level, one on time means the decoder caught up
+		int lower_count = skip_level == 2 ? 1 : SkipLowerCount;
+		int level = skip_level;
+
+		if (late_run >= SkipRaiseCount && level < 2)
+		{
+			level++;
+		}
+		else if (-late_run >= lower_count && level > 0)
+		{
+			level--;
+		}
+		else
+		{
+			return;
+		}
+
+		skip_level = level;
+		late_run = 0;
+		video.pCodecContext->skip_frame = SkipDiscard[level];
+	}
+
+	void QueueVideo(AVStream* pStream)
+	{
+		auto frame = video_frames.Back();
+
+		double frame_time = pFrame->best_effort_timestamp * av_q2d(pStream->time_base);
+		double frame_end = frame_time;
+
+		if (pFrame->duration > 0)
+		{
+			frame_end += pFrame->duration * av_q2d(pStream->time_base);
+		}
+		else if (pStream->avg_frame_rate.num)
+		{
+			frame_end += av_q2d(av_inv_q(pStream->avg_frame_rate));
+		}
+
+		// Frames between the keyframe and the target of a seek are only decoded
+		if (frame_end <= video.skip_until && frame_time < video.skip_until)
+		{
+			return;
+		}
+
+		// Frames missing between this one and the last were skipped by the decoder
+		double frame_duration = frame_end - frame_time;
+		if (skip_level && frame_duration > 0.0 && frame_time - last_frame_end > frame_duration / 2)
+		{
+			skipped_frames += (unsigned int)lrint((frame_time - last_frame_end) / frame_duration);
+		}
+
+		last_frame_end = frame_end;
+		frame_time += video.time_offset;
+
+		bool late = frame_time < Clock() - LateThreshold;
+		UpdateSkipLevel(late);
+
+		if (late)
+		{
+			late_frames++;
+		}
+
+		// Drop late frames, unless there is nothing else to show
+		if (late && video_frames.Count() > 0)
+		{
+			dropped_frames++;
+			return;
+		}
+
+		// Frames are queued by reference and only converted once they are presented
+		av_frame_move_ref(frame->frame, pFrame);
+		frame->converted = false;
+		frame->video_time = frame_time;
+		frame->serial = video.serial;
+		video_frames.Push();
+	}
+
+	void ResetVideo(double time)
+	{
+		if (frame_pending)
+		{
+			av_frame_unref(pFrame);
+			frame_pending = false;
+		}
+
+		last_frame_end = time;
+	}
+
+	bool RunVideo(std::chrono::steady_clock::time_point& deadline)
+	{
+		if (!opened)
+		{
+			return false;
+		}
+
+		UpdateClock();
+
+		// Keep the queue filled, also while paused so that playback can start immediately
+		if (StepDecoder(video, &VideoPlayer::DrainVideo, &VideoPlayer::ResetVideo))
+		{
+			return true;
+		}
+
+		// Keeps the clock in sync with the audio while playing
+		SleepDeadline(deadline);
+		return false;
+	}
+
+	// Every decoder thread keeps its own frames, so stay within the 32-bit address space
+	static int AutoThreadCount()
+	{
+		int count = (int)std::thread::hardware_concurrency();
+
+		if (count < 1)
+			return 1;
+		if (count > MaxAutoThreads)
+			return MaxAutoThreads;
+		return count;
+	}
+
+	// Drops frames that are superseded by a later one and returns the frame due for presentation
+	FrameQueue::Frame* NextFrame()
+	{
+		double time = Clock();
+		bool popped = false;
+
+		// Frames decoded before the last seek
+		while (video_frames.Front() && video_frames.Front()->serial != serial)
+		{
+			video_frames.Pop();
+			popped = true;
+		}
+
+		while (video_frames.Front(1) && video_frames.Front(1)->video_time <= time)
+		{
+			video_frames.Pop();
+			dropped_frames++;
+			popped = true;
+		}
+
+		if (popped)
+		{
+			Wake(video_task);
+		}
+
+		auto frame = video_frames.Front();
+		if (!frame || frame->video_time > time)
+		{
+			return nullptr;
+		}
+
+		return frame;
+	}
+
+	// Converts the decoded frame into the preallocated queue slot
+	void ConvertFrame(FrameQueue::Frame* frame)
+	{
+		auto start = std::chrono::steady_clock::now();
+		AVFrame* pSource = frame->frame;
+		uint8_t* dst[4];
+		int dst_stride[4];
+		av_image_fill_arrays(dst, dst_stride, frame->data, output_format, width, height, 1);
+
+		if (yuv_convert)
+		{
+			YuvToBgra(yuv_layout, yuv_full_range, pSource->data, pSource->linesize, dst[0], dst_stride[0], width, height);
+		}
+		else
+		{
+			sws_scale(pSwsContext,
+				pSource->data,
+				pSource->linesize,
+				0,
+				pSource->height,
+				dst,
+				dst_stride);
+		}
+
+		// The decoder can reuse its buffer right away
+		av_frame_unref(pSource);
+		frame->converted = true;
+
+		AddSample(stats.convert_time, stats.convert_time_max, Milliseconds(std::chrono::steady_clock::now() - start));
+	}
+
+	void GetPlanes(FrameQueue::Frame* frame, uint8_t* planes[4], int strides[4])
+	{
+		if (passthrough)
+		{
+			for (int i = 0; i < 4; ++i)
+			{
+				planes[i] = frame->frame->data[i];
+				strides[i] = frame->frame->linesize[i];
+			}
+		}
+		else
+		{
+			if (!frame->converted)
+			{
+				ConvertFrame(frame);
+			}
+
+			av_image_fill_arrays(planes, strides, frame->data, output_format, width, height, 1);
+		}
+	}
+
+	// The frame stays in the queue and cannot be overwritten until ReleaseFrame is called
+	FrameQueue::Frame* LeaseFrame()
+	{
+		if (!opened || leased)
+		{
+			return nullptr;
+		}
+
+		auto frame = NextFrame();
+		if (frame)
+		{
+			leased = true;
+			presented_frames++;
+		}
+
+		return frame;
+	}
+
+	bool OpenInput(const char* path, const ffPlayerOptions& options)
+	{
+		unsigned int flags = options.flags;
+		bool sfd = (flags & FFPLAYER_OPEN_SFD) != 0;
+
+		pFormatContext = avformat_alloc_context();
+		if (!pFormatContext)
+		{
+			OutputDebugStringA("[video] Failed to initialize ffmpeg.\n");
+			return false;
+		}
+
+		// Custom I/O if the input is read from memory
+		pFormatContext->pb = source.Context();
+
+		if (sfd)
+		{
+			OutputDebugStringA("[video] SFD compatibility mode.\n");
+			pFormatContext->audio_codec_id = AV_CODEC_ID_ADPCM_ADX;
+		}
+
+		if (avformat_open_input(&pFormatContext, path, NULL, NULL) != 0 ||
+			avformat_find_stream_info(pFormatContext, NULL) < 0)
+		{
+			char msg[4096];
+			sprintf(msg, "[video] Failed to open % s.\n", path);
+			OutputDebugStringA(msg);
+			return false;
+		}
+
+		avio_seek(pFormatContext->pb, 0, SEEK_SET);
+
+		video.index = av_find_best_stream(pFormatContext, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+		if (video.index < 0)
+		{
+			OutputDebugStringA("[video] No video stream found.\n");
+			return false;
+		}
+
+		const AVCodec* pVideoCodec = avcodec_find_decoder(pFormatContext->streams[video.index]->codecpar->codec_id);
+		pFormatContext->video_codec = pVideoCodec;
+
+		video.pCodecContext = avcodec_alloc_context3(pVideoCodec);
+		if (!video.pCodecContext)
+		{
+			OutputDebugStringA("[video] Failed to initialize video codec context.\n");
+			return false;
+		}
+
+		AVStream* pVideoStream = pFormatContext->streams[video.index];
+
+		// Start from the keyframes the demuxer knows about, the rest are added as they are read
+		for (int i = 0; i < avformat_index_get_entries_count(pVideoStream); ++i)
+		{
+			const AVIndexEntry* pEntry = avformat_index_get_entry(pVideoStream, i);
+			if (pEntry->flags & AVINDEX_KEYFRAME)
+			{
+				AddKeyFrame(pEntry->timestamp, pEntry->pos);
+			}
+		}
+
+		avformat_seek_file(pFormatContext, 0, 0, 0, pFormatContext->streams[0]->duration, 0);
+
+		if (avcodec_parameters_to_context(video.pCodecContext, pVideoStream->codecpar) < 0)
+		{
+			OutputDebugStringA("[video] Failed to initialize video codec.\n");
+			return false;
+		}
+
+		video.pCodecContext->thread_count = options.thread_count > 0 ? options.thread_count : AutoThreadCount();
+		video.pCodecContext->thread_type = 0;
+
+		if (!options.thread_type || (options.thread_type & FFPLAYER_THREAD_FRAME))
+		{
+			video.pCodecContext->thread_type |= FF_THREAD_FRAME;
+		}
+
+		if (!options.thread_type || (options.thread_type & FFPLAYER_THREAD_SLICE))
+		{
+			video.pCodecContext->thread_type |= FF_THREAD_SLICE;
+		}
+
+		// Enough buffers for the queued frames, the frames being decoded and their references
+		frame_pool.Attach(video.pCodecContext, video_frames.Capacity + video.pCodecContext->thread_count + 4);
+
+		if (avcodec_open2(video.pCodecContext, pVideoCodec, NULL) < 0)
+		{
+			OutputDebugStringA("[video] Failed to initialize video codec.\n");
+			return false;
+		}
+
+		// Scale to the requested surface size in the conversion pass
+		width = options.width ? options.width : video.pCodecContext->width;
+		height = options.height ? options.height : video.pCodecContext->height;
+		bool same_size = width == (unsigned int)video.pCodecContext->width && height == (unsigned int)video.pCodecContext->height;
+
+		output_format = ToPixelFormat(options.format);
+
+		if (flags & FFPLAYER_OPEN_YUV)
+		{
+			switch (video.pCodecContext->pix_fmt)
+			{
+			case AV_PIX_FMT_YUV420P:
+			case AV_PIX_FMT_YUVJ420P:
+			case AV_PIX_FMT_NV12:
+				output_format = video.pCodecContext->pix_fmt;
+				break;
+			default:
+				output_format = AV_PIX_FMT_YUV420P;
+				break;
+			}
+		}
+
+		planar = (av_pix_fmt_desc_get(output_format)->flags & AV_PIX_FMT_FLAG_PLANAR) != 0;
+		passthrough = same_size && output_format == video.pCodecContext->pix_fmt;
+		yuv_convert = false;
+
+		// Same-size conversion of common decoder formats to BGRA doesn't need swscale
+		if (!passthrough && same_size && (output_format == AV_PIX_FMT_BGRA || output_format == AV_PIX_FMT_BGR0) && !(flags & FFPLAYER_OPEN_SWSCALE))
+		{
+			switch (video.pCodecContext->pix_fmt)
+			{
+			case AV_PIX_FMT_YUV420P:
+			case AV_PIX_FMT_YUVJ420P:
+				yuv_convert = true;
+				yuv_layout = YUV_LAYOUT_I420;
+				break;
+			case AV_PIX_FMT_NV12:
+				yuv_convert = true;
+				yuv_layout = YUV_LAYOUT_NV12;
+				break;
+			default:
+				break;
+			}
+
+			yuv_full_range = video.pCodecContext->pix_fmt == AV_PIX_FMT_YUVJ420P || video.pCodecContext->color_range == AVCOL_RANGE_JPEG;
+		}
+
+		if (!passthrough && !yuv_convert)
+		{
+			int sws_flags = SWS_BICUBIC;
+
+			if (flags & FFPLAYER_OPEN_SCALE_FAST)
+			{
+				sws_flags = SWS_FAST_BILINEAR;
+			}
+			else if (flags & FFPLAYER_OPEN_SCALE_BILINEAR)
+			{
+				sws_flags = SWS_BILINEAR;
+			}
+
+			pSwsContext = sws_getContext(
+				video.pCodecContext->width,
+				video.pCodecContext->height,
+				video.pCodecContext->pix_fmt,
+				width,
+				height,
+				output_format,
+				sws_flags,
+				NULL,
+				NULL,
+				NULL);
+
+			if (pSwsContext == NULL)
+			{
+				OutputDebugStringA("[video] Failed to initialize video conversion.\n");
+				return false;
+			}
+		}
+
+		pPacket = av_packet_alloc();
+		if (!pPacket)
+		{
+			OutputDebugStringA("[video] Failed to allocate packet\n");
+			return false;
+		}
+
+		double frame_duration = pVideoStream->avg_frame_rate.num ? av_q2d(av_inv_q(pVideoStream->avg_frame_rate)) : 0.0;
+		video.pPacket = av_packet_alloc();
+		if (!video.pPacket || !video.packets.Allocate(VideoQueueBytes, ReadAhead, pVideoStream->time_base, frame_duration))
+		{
+			OutputDebugStringA("[video] Failed to allocate video packet queue.\n");
+			return false;
+		}
+
+		pFrame = av_frame_alloc();
+		if (!pFrame)
+		{
+			OutputDebugStringA("[video] Failed to allocate packet frame.\n");
+			return false;
+		}
+
+		if (!video_frames.Allocate(passthrough ? 0 : av_image_get_buffer_size(output_format, width, height, 1)))
+		{
+			OutputDebugStringA("[video] Failed to allocate video frame queue.\n");
+			return false;
+		}
+
+		audio.index = av_find_best_stream(pFormatContext, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+		if (audio.index >= 0)
+		{
+			const AVCodec* pAudioCodec = avcodec_find_decoder(pFormatContext->streams[audio.index]->codecpar->codec_id);
+			pFormatContext->audio_codec = pAudioCodec;
+
+			audio.pCodecContext = avcodec_alloc_context3(pAudioCodec);
+			if (!audio.pCodecContext)
+			{
+				OutputDebugStringA("[video] Failed to initialize audio codec context.\n");
+				return false;
+			}
+
+			AVStream* pAudioStream = pFormatContext->streams[audio.index];
+
+			if (avcodec_parameters_to_context(audio.pCodecContext, pAudioStream->codecpar) < 0 ||
+				avcodec_open2(audio.pCodecContext, pAudioCodec, NULL) < 0)
+			{
+				OutputDebugStringA("[video] failed to initialize audio codec.\n");
+				return false;
+			}
+
+			pAudioFrame = av_frame_alloc();
+			if (!pAudioFrame)
+			{
+				OutputDebugStringA("[video] Failed to allocate audio frame.\n");
+				return false;
+			}
+
+			// Force set audio channel layout for SFD
+			if (sfd)
+			{
+				audio.pCodecContext->ch_layout.order = AV_CHANNEL_ORDER_NATIVE;
+				audio.pCodecContext->ch_layout.u.mask = AV_CH_FRONT_LEFT | AV_CH_FRONT_RIGHT;
+			}
+
+			// Initialize resampler
+			if (swr_alloc_set_opts2(&pSwrContext, &audio.pCodecContext->ch_layout, AV_SAMPLE_FMT_FLT, audio.pCodecContext->sample_rate,
+				&audio.pCodecContext->ch_layout, (AVSampleFormat)pAudioStream->codecpar->format, pAudioStream->codecpar->sample_rate, 0, nullptr) < 0 ||
+				swr_init(pSwrContext) < 0)
+			{
+				OutputDebugStringA("[video] Failed to initialize audio conversion.\n");
+				return false;
+			}
+
+			audio_channels = audio.pCodecContext->ch_layout.nb_channels;
+
+			if (!audio_samples.Allocate((unsigned int)(audio.pCodecContext->sample_rate * AudioBufferLength), audio_channels))
+			{
+				OutputDebugStringA("[video] Failed to allocate audio buffer.\n");
+				return false;
+			}
+
+			audio.pPacket = av_packet_alloc();
+			if (!audio.pPacket || !audio.packets.Allocate(AudioQueueBytes, ReadAhead, pAudioStream->time_base, 0.0))
+			{
+				OutputDebugStringA("[video] Failed to allocate audio packet queue.\n");
+				return false;
+			}
+
+			// BASS pulls the decoded samples from the audio queue
+			BassHandle = BASS_StreamCreate(audio.pCodecContext->sample_rate, audio_channels, BASS_SAMPLE_FLOAT, AudioStreamProc, this);
+			if (!BassHandle)
+			{
+				OutputDebugStringA("[video] Failed to initialize audio library.");
+				return false;
+			}
+
+			// Audio starts with Play() so that it stays in sync with the video
+		}
+
+		clock_time = pVideoStream->start_time != AV_NOPTS_VALUE ? pVideoStream->start_time * av_q2d(pVideoStream->time_base) : 0.0;
+		audio_started = false;
+
+		loop = (flags & FFPLAYER_OPEN_LOOP) != 0;
+		loop_start = clock_time;
+		last_frame_end = clock_time;
+		skip_level = 0;
+		late_run = 0;
+		dropped_frames = 0;
+		skipped_frames = 0;
+		late_frames = 0;
+		presented_frames = 0;
+		decode_time = 0.0;
+		av_drift = 0.0;
+		stats = {};
+		pass_end = clock_time;
+		video.skip_until = clock_time;
+		audio.skip_until = clock_time;
+		video.serial = serial;
+		audio.serial = serial;
+		seek_requested = false;
+		opened = true;
+
+		clock_real = std::chrono::steady_clock::now();
+		pool.Add(&demux_task);
+		pool.Add(&video_task);
+
+		if (audio.index >= 0)
+		{
+			pool.Add(&audio_task);
+		}
+
+		return true;
+	}
+
+	// Frees everything OpenInput allocated, also after it failed halfway
+	void Release()
+	{
+		packet_pending = false;
+		frame_pending = false;
+		audio_pending = 0;
+		end_of_file = false;
+		keyframes.clear();
+
+		for (Stream* stream : { &video, &audio })
+		{
+			stream->packets.Free();
+			if (stream->pPacket) av_packet_free(&stream->pPacket);
+			if (stream->pCodecContext) avcodec_free_context(&stream->pCodecContext);
+			stream->index = -1;
+			stream->draining = false;
+			stream->flushed = false;
+			stream->decoder_end = false;
+			stream->time_offset = 0.0;
+			stream->done = false;
+		}
+
+		if (pFormatContext) avformat_close_input(&pFormatContext);
+		source.Close();
+		if (pPacket) av_packet_free(&pPacket);
+		if (pFrame) av_frame_free(&pFrame);
+		if (pAudioFrame) av_frame_free(&pAudioFrame);
+
+		if (pSwsContext) { sws_freeContext(pSwsContext); pSwsContext = nullptr; }
+		video_frames.Free();
+		frame_pool.Free();
+
+		if (pSwrContext) swr_free(&pSwrContext);
+		if (BassHandle) { BASS_StreamFree(BassHandle); BassHandle = NULL; };
+		if (audio_buffer) { av_freep(&audio_buffer); audio_buffer_size = 0; }
+		audio_samples.Free();
+	}
+
+public:
+	unsigned int Width()
+	{
+		return width;
+	}
+
+	unsigned int Height()
+	{
+		return height;
+	}
+
+	// Everything has been decoded and shown
+	bool Finished()
+	{
+		return Decoded() && video_frames.Count() == 0;
+	}
+
+	bool GetStats(ffPlayerStats* result)
+	{
+		if (!opened || !result)
+		{
+			return false;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(stats_mutex);
+			*result = stats;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(clock_mutex);
+			result->av_drift = av_drift;
+		}
+
+		result->queued_frames = video_frames.Count();
+		result->presented_frames = presented_frames;
+		result->dropped_frames = dropped_frames;
+		result->skipped_frames = skipped_frames;
+		result->late_frames = late_frames;
+		result->audio_buffered = BassHandle ? (double)audio_samples.Count() / audio.pCodecContext->sample_rate : 0.0;
+		return true;
+	}
+
+	void Seek(double time)
+	{
+		if (!opened)
+		{
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(seek_mutex);
+			seek_time = time;
+			seek_requested = true;
+			serial++;
+		}
+
+		Wake(demux_task);
+	}
+
+	bool GetFrameBuffer(uint8_t* pBuffer)
+	{
+		if (!opened || leased || planar)
+		{
+			return false;
+		}
+
+		auto frame = NextFrame();
+		if (!frame)
+		{
+			return false;
+		}
+
+		uint8_t* planes[4];
+		int strides[4];
+		GetPlanes(frame, planes, strides);
+		int row_size = av_image_get_linesize(output_format, width, 0);
+		av_image_copy_plane(pBuffer, row_size, planes[0], strides[0], row_size, height);
+		presented_frames++;
+
+		video_frames.Pop();
+		Wake(video_task);
+		return true;
+	}
+
+	bool AcquireFrame(const uint8_t** data, int* stride, double* pts)
+	{
+		if (planar)
+		{
+			return false;
+		}
+
+		auto frame = LeaseFrame();
+		if (!frame)
+		{
+			return false;
+		}
+
+		uint8_t* planes[4];
+		int strides[4];
+		GetPlanes(frame, planes, strides);
+
+		if (data) *data = planes[0];
+		if (stride) *stride = strides[0];
+		if (pts) *pts = frame->video_time;
+		return true;
+	}
+
+	bool GetFramePlanes(const uint8_t** data, int* stride, int* format, double* pts)
+	{
+		if (!planar)
+		{
+			return false;
+		}
+
+		auto frame = LeaseFrame();
+		if (!frame)
+		{
+			return false;
+		}
+
+		uint8_t* planes[4];
+		int strides[4];
+		GetPlanes(frame, planes, strides);
+
+		for (int i = 0; i < 3; ++i)
+		{
+			if (data) data[i] = planes[i];
+			if (stride) stride[i] = strides[i];
+		}
+
+		if (format) *format = FromPixelFormat(output_format);
+		if (pts) *pts = frame->video_time;
+		return true;
+	}
+
+	void ReleaseFrame()
+	{
+		if (opened && leased)
+		{
+			leased = false;
+			video_frames.Pop();
+			Wake(video_task);
+		}
+	}
+
+	void Play()
+	{
+		{
+			std::lock_guard<std::mutex> lock(clock_mutex);
+			clock_real = std::chrono::steady_clock::now();
+			play = true;
+		}
+
+		if (BassHandle)
+		{
+			BASS_ChannelPlay(BassHandle, FALSE);
+		}
+
+		WakeAll();
+	}
+
+	void Pause()
+	{
+		{
+			std::lock_guard<std::mutex> lock(clock_mutex);
+			clock_time = ClockLocked(std::chrono::steady_clock::now());
+			play = false;
+		}
+
+		if (BassHandle)
+		{
+			BASS_ChannelPause(BassHandle);
+		}
+
+		WakeAll();
+	}
+
+	bool Open(const char* path, const ffPlayerOptions& options)
+	{
+		if (opened)
+		{
+			Close();
+		}
+
+		// Read through a mapping of the file, FFmpeg opens it itself if it doesn't fit into the address space
+		source.OpenFile(path);
+		if (!OpenInput(path, options))
+		{
+			Release();
+			return false;
+		}
+
+		return true;
+	}
+
+	bool OpenMemory(const void* data, size_t size, const char* name_hint, const ffPlayerOptions& options)
+	{
+		if (opened)
+		{
+			Close();
+		}
+
+		if (!source.OpenMemory(data, size))
+		{
+			OutputDebugStringA("[video] Failed to open memory buffer.\n");
+			return false;
+		}
+
+		// The name is only used to detect the format
+		if (!OpenInput(name_hint ? name_hint : "", options))
+		{
+			Release();
+			return false;
+		}
+
+		return true;
+	}
+
+	void Close()
+	{
+		if (opened)
+		{
+			play = false;
+			opened = false;
+			leased = false;
+
+			// Returns once no worker runs a task of this player anymore, the demuxer first so that it stops waking the others
+			pool.Remove(&demux_task);
+			pool.Remove(&video_task);
+			pool.Remove(&audio_task);
+		}
+
+		Release();
+	}
+
+	// Holding on to the pool keeps it alive for as long as any player exists
+	VideoPlayer() : pool(DecoderPool::Instance())
+	{
+	}
+
+	~VideoPlayer()
+	{
+		Close();
+	}
+};
+
+// Players opened ahead of time by ffPlayerPrefetch. The next open of the same video with the
+// same options takes over the player, which has already probed the file and queued its first frames.
+class Prefetcher
+{
+private:
+	struct Entry
+	{
+		std::string path;
+		ffPlayerOptions options;
+		std::unique_ptr<VideoPlayer> player;
+		std::thread thread; // Opens the player
+		bool opened = false;
+	};
+
+	std::mutex mutex;
+	std::list<std::unique_ptr<Entry>> entries; // Oldest first
+
+	static constexpr size_t MaxEntries = 2;
+
+	static bool Matches(const Entry& entry, const char* path, const ffPlayerOptions& options)
+	{
+		return entry.path == path && memcmp(&entry.options, &options, sizeof(options)) == 0;
+	}
+
+public:
+	void Start(const char* path, const ffPlayerOptions& options)
+	{
+		std::unique_ptr<Entry> evicted;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			for (auto& entry : entries)
+			{
+				if (Matches(*entry, path, options))
+				{
+					return;
+				}
+			}
+
+			std::unique_ptr<Entry> entry(new Entry);
+			entry->path = path;
+			entry->options = options;
+			entry->player.reset(new VideoPlayer);
+
+			Entry* pEntry = entry.get();
+			entry->thread = std::thread([pEntry]()
+			{
+				pEntry->opened = pEntry->player->Open(pEntry->path.c_str(), pEntry->options);
+			});
+
+			entries.push_back(std::move(entry));
+
+			if (entries.size() > MaxEntries)
+			{
+				evicted = std::move(entries.front());
+				entries.pop_front();
+			}
+		}
+
+		// The evicted player is closed when the entry is destroyed
+		if (evicted)
+		{
+			evicted->thread.join();
+		}
+	}
+
+	// Returns the prefetched player for the video, waiting for it to finish opening
+	std::unique_ptr<VideoPlayer> Take(const char* path, const ffPlayerOptions& options)
+	{
+		std::unique_ptr<Entry> entry;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			for (auto it = entries.begin(); it != entries.end(); ++it)
+			{
+				if (Matches(**it, path, options))
+				{
+					entry = std::move(*it);
+					entries.erase(it);
+					break;
+				}
+			}
+		}
+
+		if (!entry)
+		{
+			return nullptr;
+		}
+
+		entry->thread.join();
+
+		if (!entry->opened)
+		{
+			return nullptr;
+		}
+
+		return std::move(entry->player);
+	}
+
+	~Prefetcher()
+	{
+		for (auto& entry : entries)
+		{
+			entry->thread.join();
+		}
+	}
+};
+
+struct ffPlayerInstance
+{
+	std::unique_ptr<VideoPlayer> player{ new VideoPlayer };
+};
+
+// Instance used by the exports without a handle
+static ffPlayerInstance default_instance;
+
+// Destroyed before the default instance, and with it the decoder pool
+static Prefetcher prefetcher;
+
+static bool OpenInstance(ffPlayerInstance* instance, const char* path, const ffPlayerOptions& options)
+{
+	std::unique_ptr<VideoPlayer> prefetched = prefetcher.Take(path, options);
+
+	if (prefetched)
+	{
+		// The previous player is closed as prefetched goes out of scope
+		instance->player.swap(prefetched);
+		return true;
+	}
+
+	return instance->player->Open(path, options);
+}
+
+extern "C"
+{
+	__declspec(dllexport) ffPlayerInstance* ffPlayerCreate()
+	{
+		return new ffPlayerInstance;
+	}
+
+	__declspec(dllexport) void ffPlayerDestroy(ffPlayerInstance* instance)
+	{
+		if (instance && instance != &default_instance)
+		{
+			delete instance;
+		}
+	}
+
+	__declspec(dllexport) void ffPlayerInstancePlay(ffPlayerInstance* instance)
+	{
+		return instance->player->Play();
+	}
+
+	__declspec(dllexport) void ffPlayerInstancePause(ffPlayerInstance* instance)
+	{
+		return instance->player->Pause();
+	}
+
+	__declspec(dllexport) bool ffPlayerInstanceFinished(ffPlayerInstance* instance)
+	{
+		return instance->player->Finished();
+	}
+
+	__declspec(dllexport) bool ffPlayerInstanceGetStats(ffPlayerInstance* instance, ffPlayerStats* stats)
+	{
+		return instance->player->GetStats(stats);
+	}
+
+	__declspec(dllexport) void ffPlayerInstanceSeek(ffPlayerInstance* instance, double seconds)
+	{
+		return instance->player->Seek(seconds);
+	}
+
+	__declspec(dllexport) bool ffPlayerInstanceOpen(ffPlayerInstance* instance, const char* path, bool sfd)
+	{
+		ffPlayerOptions options = {};
+		options.flags = sfd ? FFPLAYER_OPEN_SFD : 0;
+		return OpenInstance(instance, path, options);
+	}
+
+	__declspec(dllexport) bool ffPlayerInstanceOpenEx(ffPlayerInstance* instance, const char* path, unsigned int flags, unsigned int width, unsigned int height, int format)
+	{
+		ffPlayerOptions options = {};
+		options.flags = flags;
+		options.width = width;
+		options.height = height;
+		options.format = format;
+		return OpenInstance(instance, path, options);
+	}
+
+	__declspec(dllexport) bool ffPlayerInstanceOpenWithOptions(ffPlayerInstance* instance, const char* path, const ffPlayerOptions* options)
+	{
+		ffPlayerOptions defaults = {};
+		return OpenInstance(instance, path, options ? *options : defaults);
+	}
+
+	__declspec(dllexport) bool ffPlayerInstanceOpenMemory(ffPlayerInstance* instance, const void* buf, size_t size, const char* name_hint)
+	{
+		ffPlayerOptions options = {};
+		return instance->player->OpenMemory(buf, size, name_hint, options);
+	}
+
+	__declspec(dllexport) bool ffPlayerInstanceOpenMemoryWithOptions(ffPlayerInstance* instance, const void* buf, size_t size, const char* name_hint, const ffPlayerOptions* options)
+	{
+		ffPlayerOptions defaults = {};
+		return instance->player->OpenMemory(buf, size, name_hint, options ? *options : defaults);
+	}
+
+	__declspec(dllexport) void ffPlayerPrefetch(const char* path)
+	{
+		ffPlayerOptions options = {};
+		prefetcher.Start(path, options);
+	}
+
+	__declspec(dllexport) void ffPlayerPrefetchWithOptions(const char* path, const ffPlayerOptions* options)
+	{
+		ffPlayerOptions defaults = {};
+		prefetcher.Start(path, options ? *options : defaults);
+	}
+
+	__declspec(dllexport) void ffPlayerInstanceClose(ffPlayerInstance* instance)
+	{
+		return instance->player->Close();
+	}
+
+	__declspec(dllexport) bool ffPlayerInstanceGetFrameBuffer(ffPlayerInstance* instance, unsigned char* pBuffer)
+	{
+		return instance->player->GetFrameBuffer(pBuffer);
+	}
+
+	__declspec(dllexport) bool ffPlayerInstanceAcquireFrame(ffPlayerInstance* instance, const unsigned char** data, int* stride, double* pts)
+	{
+		return instance->player->AcquireFrame(data, stride, pts);
+	}
+
+	__declspec(dllexport) bool ffPlayerInstanceGetFramePlanes(ffPlayerInstance* instance, const unsigned char** planes, int* strides, int* format, double* pts)
+	{
+		return instance->player->GetFramePlanes(planes, strides, format, pts);
+	}
+
+	__declspec(dllexport) void ffPlayerInstanceReleaseFrame(ffPlayerInstance* instance)
+	{
+		return instance->player->ReleaseFrame();
+	}
+
+	__declspec(dllexport) unsigned int ffPlayerInstanceWidth(ffPlayerInstance* instance)
+	{
+		return instance->player->Width();
+	}
+
+	__declspec(dllexport) unsigned int ffPlayerInstanceHeight(ffPlayerInstance* instance)
+	{
+		return instance->player->Height();
+	}
+
+	__declspec(dllexport) void ffPlayerPlay()
+	{
+		return ffPlayerInstancePlay(&default_instance);
+	}
+
+	__declspec(dllexport) void ffPlayerPause()
+	{
+		return ffPlayerInstancePause(&default_instance);
+	}
 
 	__declspec(dllexport) bool ffPlayerFinished()
 	{
-		return player.Finished();
+		return ffPlayerInstanceFinished(&default_instance);
+	}
+
+	__declspec(dllexport) bool ffPlayerGetStats(ffPlayerStats* stats)
+	{
+		return ffPlayerInstanceGetStats(&default_instance, stats);
+	}
+
+	__declspec(dllexport) void ffPlayerSeek(double seconds)
+	{
+		return ffPlayerInstanceSeek(&default_instance, seconds);
 	}
 
 	__declspec(dllexport) bool ffPlayerOpen(const char* path, bool sfd)
 	{
-		return player.Open(path, sfd);
+		return ffPlayerInstanceOpen(&default_instance, path, sfd);
+	}
+
+	__declspec(dllexport) bool ffPlayerOpenEx(const char* path, unsigned int flags, unsigned int width, unsigned int height, int format)
+	{
+		return ffPlayerInstanceOpenEx(&default_instance, path, flags, width, height, format);
+	}
+
+	__declspec(dllexport) bool ffPlayerOpenWithOptions(const char* path, const ffPlayerOptions* options)
+	{
+		return ffPlayerInstanceOpenWithOptions(&default_instance, path, options);
+	}
+
+	__declspec(dllexport) bool ffPlayerOpenMemory(const void* buf, size_t size, const char* name_hint)
+	{
+		return ffPlayerInstanceOpenMemory(&default_instance, buf, size, name_hint);
+	}
+
+	__declspec(dllexport) bool ffPlayerOpenMemoryWithOptions(const void* buf, size_t size, const char* name_hint, const ffPlayerOptions* options)
+	{
+		return ffPlayerInstanceOpenMemoryWithOptions(&default_instance, buf, size, name_hint, options);
 	}
 
 	__declspec(dllexport) void ffPlayerClose()
 	{
-		return player.Close();
+		return ffPlayerInstanceClose(&default_instance);
 	}
 
 	__declspec(dllexport) bool ffPlayerGetFrameBuffer(unsigned char* pBuffer)
 	{
-		return player.GetFrameBuffer(pBuffer);
+		return ffPlayerInstanceGetFrameBuffer(&default_instance, pBuffer);
+	}
+
+	__declspec(dllexport) bool ffPlayerAcquireFrame(const unsigned char** data, int* stride, double* pts)
+	{
+		return ffPlayerInstanceAcquireFrame(&default_instance, data, stride, pts);
+	}
+
+	__declspec(dllexport) bool ffPlayerGetFramePlanes(const unsigned char** planes, int* strides, int* format, double* pts)
+	{
+		return ffPlayerInstanceGetFramePlanes(&default_instance, planes, strides, format, pts);
+	}
+
+	__declspec(dllexport) void ffPlayerReleaseFrame()
+	{
+		return ffPlayerInstanceReleaseFrame(&default_instance);
 	}
 
 	__declspec(dllexport) unsigned int ffPlayerWidth()
 	{
-		return player.Width();
+		return ffPlayerInstanceWidth(&default_instance);
 	}
 
 	__declspec(dllexport) unsigned int ffPlayerHeight()
 	{
-		return player.Height();
+		return ffPlayerInstanceHeight(&default_instance);
 	}
 }
\ No newline at end of file
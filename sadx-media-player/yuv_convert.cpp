@@ -0,0 +1,280 @@
+#include "yuv_convert.h"
+
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#include <cpuid.h>
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+// Fixed point math shared by all kernels so that they produce identical output:
+// inputs are shifted left by 6, multiplied by Q13 coefficients keeping the high 16 bits,
+// which leaves 3 fractional bits that are rounded away at the end.
+struct YuvCoefficients
+{
+	int16_t y_offset;
+	int16_t y;
+	int16_t rv;
+	int16_t gu;
+	int16_t gv;
+	int16_t bu;
+};
+
+static const YuvCoefficients coefficients_limited = { 16, 9539, 13075, 3209, 6660, 16525 };
+static const YuvCoefficients coefficients_full = { 0, 8192, 11485, 2819, 5850, 14516 };
+
+static inline int MulHi(int a, int b)
+{
+	return (a * b) >> 16;
+}
+
+static inline uint8_t Clamp(int x)
+{
+	return x < 0 ? 0 : x > 255 ? 255 : (uint8_t)x;
+}
+
+static void RowScalar(const uint8_t* y, const uint8_t* u, const uint8_t* v, int chroma_step,
+	uint8_t* dst, int start, int width, const YuvCoefficients& c)
+{
+	for (int x = start; x < width; ++x)
+	{
+		int cu = (u[(x >> 1) * chroma_step] - 128) << 6;
+		int cv = (v[(x >> 1) * chroma_step] - 128) << 6;
+		int yy = MulHi((y[x] - c.y_offset) << 6, c.y);
+
+		dst[x * 4 + 0] = Clamp((yy + MulHi(cu, c.bu) + 4) >> 3);
+		dst[x * 4 + 1] = Clamp((yy - MulHi(cu, c.gu) - MulHi(cv, c.gv) + 4) >> 3);
+		dst[x * 4 + 2] = Clamp((yy + MulHi(cv, c.rv) + 4) >> 3);
+		dst[x * 4 + 3] = 0xFF;
+	}
+}
+
+// 8 pixels of 16 bit luma and chroma to 16 bit B, G, R
+static inline void ComputeSSE2(__m128i y, __m128i u, __m128i v, const YuvCoefficients& c,
+	__m128i& b, __m128i& g, __m128i& r)
+{
+	const __m128i round = _mm_set1_epi16(4);
+
+	y = _mm_slli_epi16(_mm_sub_epi16(y, _mm_set1_epi16(c.y_offset)), 6);
+	y = _mm_mulhi_epi16(y, _mm_set1_epi16(c.y));
+
+	b = _mm_add_epi16(y, _mm_mulhi_epi16(u, _mm_set1_epi16(c.bu)));
+	g = _mm_sub_epi16(y, _mm_mulhi_epi16(u, _mm_set1_epi16(c.gu)));
+	g = _mm_sub_epi16(g, _mm_mulhi_epi16(v, _mm_set1_epi16(c.gv)));
+	r = _mm_add_epi16(y, _mm_mulhi_epi16(v, _mm_set1_epi16(c.rv)));
+
+	b = _mm_srai_epi16(_mm_add_epi16(b, round), 3);
+	g = _mm_srai_epi16(_mm_add_epi16(g, round), 3);
+	r = _mm_srai_epi16(_mm_add_epi16(r, round), 3);
+}
+
+// 16 pixels, chroma holds 8 samples as 16 bit already centered and shifted
+static inline void StoreSSE2(__m128i y8, __m128i u, __m128i v, const YuvCoefficients& c, uint8_t* dst)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i b0, g0, r0, b1, g1, r1;
+
+	ComputeSSE2(_mm_unpacklo_epi8(y8, zero), _mm_unpacklo_epi16(u, u), _mm_unpacklo_epi16(v, v), c, b0, g0, r0);
+	ComputeSSE2(_mm_unpackhi_epi8(y8, zero), _mm_unpackhi_epi16(u, u), _mm_unpackhi_epi16(v, v), c, b1, g1, r1);
+
+	__m128i b = _mm_packus_epi16(b0, b1);
+	__m128i g = _mm_packus_epi16(g0, g1);
+	__m128i r = _mm_packus_epi16(r0, r1);
+	__m128i a = _mm_set1_epi8((char)0xFF);
+
+	__m128i bg_lo = _mm_unpacklo_epi8(b, g);
+	__m128i bg_hi = _mm_unpackhi_epi8(b, g);
+	__m128i ra_lo = _mm_unpacklo_epi8(r, a);
+	__m128i ra_hi = _mm_unpackhi_epi8(r, a);
+
+	_mm_storeu_si128((__m128i*)(dst + 0), _mm_unpacklo_epi16(bg_lo, ra_lo));
+	_mm_storeu_si128((__m128i*)(dst + 16), _mm_unpackhi_epi16(bg_lo, ra_lo));
+	_mm_storeu_si128((__m128i*)(dst + 32), _mm_unpacklo_epi16(bg_hi, ra_hi));
+	_mm_storeu_si128((__m128i*)(dst + 48), _mm_unpackhi_epi16(bg_hi, ra_hi));
+}
+
+static int RowSSE2(const uint8_t* y, const uint8_t* u, const uint8_t* v, YuvLayout layout,
+	uint8_t* dst, int width, const YuvCoefficients& c)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i center = _mm_set1_epi16(128);
+	int x = 0;
+
+	for (; x + 16 <= width; x += 16)
+	{
+		__m128i cu, cv;
+
+		if (layout == YUV_LAYOUT_NV12)
+		{
+			__m128i uv = _mm_loadu_si128((const __m128i*)(u + x));
+			cu = _mm_and_si128(uv, _mm_set1_epi16(0xFF));
+			cv = _mm_srli_epi16(uv, 8);
+		}
+		else
+		{
+			cu = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(u + x / 2)), zero);
+			cv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(v + x / 2)), zero);
+		}
+
+		cu = _mm_slli_epi16(_mm_sub_epi16(cu, center), 6);
+		cv = _mm_slli_epi16(_mm_sub_epi16(cv, center), 6);
+
+		StoreSSE2(_mm_loadu_si128((const __m128i*)(y + x)), cu, cv, c, dst + x * 4);
+	}
+
+	return x;
+}
+
+TARGET_AVX2 static inline void ComputeAVX2(__m256i y, __m256i u, __m256i v, const YuvCoefficients& c,
+	__m256i& b, __m256i& g, __m256i& r)
+{
+	const __m256i round = _mm256_set1_epi16(4);
+
+	y = _mm256_slli_epi16(_mm256_sub_epi16(y, _mm256_set1_epi16(c.y_offset)), 6);
+	y = _mm256_mulhi_epi16(y, _mm256_set1_epi16(c.y));
+
+	b = _mm256_add_epi16(y, _mm256_mulhi_epi16(u, _mm256_set1_epi16(c.bu)));
+	g = _mm256_sub_epi16(y, _mm256_mulhi_epi16(u, _mm256_set1_epi16(c.gu)));
+	g = _mm256_sub_epi16(g, _mm256_mulhi_epi16(v, _mm256_set1_epi16(c.gv)));
+	r = _mm256_add_epi16(y, _mm256_mulhi_epi16(v, _mm256_set1_epi16(c.rv)));
+
+	b = _mm256_srai_epi16(_mm256_add_epi16(b, round), 3);
+	g = _mm256_srai_epi16(_mm256_add_epi16(g, round), 3);
+	r = _mm256_srai_epi16(_mm256_add_epi16(r, round), 3);
+}
+
+TARGET_AVX2 static int RowAVX2(const uint8_t* y, const uint8_t* u, const uint8_t* v, YuvLayout layout,
+	uint8_t* dst, int width, const YuvCoefficients& c)
+{
+	const __m256i center = _mm256_set1_epi16(128);
+	int x = 0;
+
+	for (; x + 32 <= width; x += 32)
+	{
+		__m256i cu, cv;
+
+		// 16 chroma samples as 16 bit, lane 0 holds 0-7 and lane 1 holds 8-15
+		if (layout == YUV_LAYOUT_NV12)
+		{
+			__m256i uv = _mm256_loadu_si256((const __m256i*)(u + x));
+			cu = _mm256_and_si256(uv, _mm256_set1_epi16(0xFF));
+			cv = _mm256_srli_epi16(uv, 8);
+		}
+		else
+		{
+			cu = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(u + x / 2)));
+			cv = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(v + x / 2)));
+		}
+
+		cu = _mm256_slli_epi16(_mm256_sub_epi16(cu, center), 6);
+		cv = _mm256_slli_epi16(_mm256_sub_epi16(cv, center), 6);
+
+		// Reorder to 0-3 8-11 | 4-7 12-15 so that the in-lane unpacks below duplicate in pixel order
+		cu = _mm256_permute4x64_epi64(cu, 0xD8);
+		cv = _mm256_permute4x64_epi64(cv, 0xD8);
+
+		__m256i b0, g0, r0, b1, g1, r1;
+		ComputeAVX2(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(y + x))),
+			_mm256_unpacklo_epi16(cu, cu), _mm256_unpacklo_epi16(cv, cv), c, b0, g0, r0);
+		ComputeAVX2(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(y + x + 16))),
+			_mm256_unpackhi_epi16(cu, cu), _mm256_unpackhi_epi16(cv, cv), c, b1, g1, r1);
+
+		// Packing is per lane, which leaves pixels 0-7 16-23 | 8-15 24-31
+		__m256i b = _mm256_packus_epi16(b0, b1);
+		__m256i g = _mm256_packus_epi16(g0, g1);
+		__m256i r = _mm256_packus_epi16(r0, r1);
+		__m256i a = _mm256_set1_epi8((char)0xFF);
+
+		__m256i bg_lo = _mm256_unpacklo_epi8(b, g); // 0-7 | 8-15
+		__m256i bg_hi = _mm256_unpackhi_epi8(b, g); // 16-23 | 24-31
+		__m256i ra_lo = _mm256_unpacklo_epi8(r, a);
+		__m256i ra_hi = _mm256_unpackhi_epi8(r, a);
+
+		__m256i p0 = _mm256_unpacklo_epi16(bg_lo, ra_lo); // 0-3 | 8-11
+		__m256i p1 = _mm256_unpackhi_epi16(bg_lo, ra_lo); // 4-7 | 12-15
+		__m256i p2 = _mm256_unpacklo_epi16(bg_hi, ra_hi); // 16-19 | 24-27
+		__m256i p3 = _mm256_unpackhi_epi16(bg_hi, ra_hi); // 20-23 | 28-31
+
+		uint8_t* out = dst + x * 4;
+		_mm256_storeu_si256((__m256i*)(out + 0), _mm256_permute2x128_si256(p0, p1, 0x20));
+		_mm256_storeu_si256((__m256i*)(out + 32), _mm256_permute2x128_si256(p0, p1, 0x31));
+		_mm256_storeu_si256((__m256i*)(out + 64), _mm256_permute2x128_si256(p2, p3, 0x20));
+		_mm256_storeu_si256((__m256i*)(out + 96), _mm256_permute2x128_si256(p2, p3, 0x31));
+	}
+
+	return x;
+}
+
+static YuvConvertLevel DetectLevel()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	int max_leaf = info[0];
+
+	__cpuid(info, 1);
+	bool sse2 = (info[3] & (1 << 26)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	bool avx2 = false;
+
+	if (max_leaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6)
+	{
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+	}
+#else
+	__builtin_cpu_init();
+	bool sse2 = __builtin_cpu_supports("sse2");
+	bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+	if (avx2)
+		return YUV_CONVERT_AVX2;
+	if (sse2)
+		return YUV_CONVERT_SSE2;
+	return YUV_CONVERT_SCALAR;
+}
+
+YuvConvertLevel YuvConvertGetLevel()
+{
+	static const YuvConvertLevel level = DetectLevel();
+	return level;
+}
+
+void YuvToBgra(YuvConvertLevel level, YuvLayout layout, bool full_range,
+	const uint8_t* const src[], const int src_stride[],
+	uint8_t* dst, int dst_stride, int width, int height)
+{
+	const YuvCoefficients& c = full_range ? coefficients_full : coefficients_limited;
+	int chroma_step = layout == YUV_LAYOUT_NV12 ? 2 : 1;
+
+	if (level > YuvConvertGetLevel())
+	{
+		level = YuvConvertGetLevel();
+	}
+
+	for (int row = 0; row < height; ++row)
+	{
+		const uint8_t* y = src[0] + row * src_stride[0];
+		const uint8_t* u = src[1] + (row >> 1) * src_stride[1];
+		const uint8_t* v = layout == YUV_LAYOUT_NV12 ? u + 1 : src[2] + (row >> 1) * src_stride[2];
+		uint8_t* out = dst + row * dst_stride;
+		int x = 0;
+
+		if (level == YUV_CONVERT_AVX2)
+		{
+			x = RowAVX2(y, u, v, layout, out, width, c);
+		}
+		else if (level == YUV_CONVERT_SSE2)
+		{
+			x = RowSSE2(y, u, v, layout, out, width, c);
+		}
+
+		RowScalar(y, u, v, chroma_step, out, x, width, c);
+	}
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+
+// Same-size conversion of 4:2:0 frames to BGRA (BT.601), using SSE2 or AVX2 when the CPU supports it.
+// Chroma is upsampled by repetition, which matches the unscaled swscale converters.
+
+enum YuvLayout
+{
+	YUV_LAYOUT_I420, // Separate U and V planes
+	YUV_LAYOUT_NV12, // Interleaved UV plane
+};
+
+enum YuvConvertLevel
+{
+	YUV_CONVERT_SCALAR,
+	YUV_CONVERT_SSE2,
+	YUV_CONVERT_AVX2,
+};
+
+// Highest instruction set supported by the CPU and OS, detected once
+YuvConvertLevel YuvConvertGetLevel();
+
+// Converts a frame with the given kernel level (clamped to what the CPU supports)
+void YuvToBgra(YuvConvertLevel level, YuvLayout layout, bool full_range,
+	const uint8_t* const src[], const int src_stride[],
+	uint8_t* dst, int dst_stride, int width, int height);
+
+// Converts a frame with the best kernel for this CPU
+inline void YuvToBgra(YuvLayout layout, bool full_range,
+	const uint8_t* const src[], const int src_stride[],
+	uint8_t* dst, int dst_stride, int width, int height)
+{
+	YuvToBgra(YuvConvertGetLevel(), layout, full_range, src, src_stride, dst, dst_stride, width, height);
+}
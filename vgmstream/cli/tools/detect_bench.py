@@ -0,0 +1,158 @@
+# DETECT BENCH - VGMSTREAM FORMAT DETECTION MICRO-BENCHMARK
+#
+# Creates a corpus of small synthetic files (header IDs and extensions
+# declared in src/base/detect.c, plus random data) and times how long
+# new and old CLI versions take to detect them with -m. Most files are
+# rejected, so this mainly measures failed probes. Output of both CLIs
+# is compared too, as detection must accept the same files.
+
+import os, argparse, time, random, re, subprocess, tempfile, shutil
+
+DEFAULT_CLI_NEW = 'vgmstream-cli'
+DEFAULT_CLI_OLD = 'vgmstream-cli_old'
+DETECT_SOURCE = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '..', 'src', 'base', 'detect.c')
+
+FILES_PER_CALL = 100    # files passed to each CLI call, amortizes process start
+CALL_TIMEOUT = 30       # a few metas may get stuck on garbage, those calls are skipped
+
+###############################################################################
+
+def parse_args():
+    description = (
+        "Times vgmstream CLI format detection over small synthetic files"
+    )
+    epilog = (
+        "examples:\n"
+        "%(prog)s\n"
+        "- compares detection time of new and old CLI\n"
+        "%(prog)s -po -c 5000\n"
+        "- times only the new CLI with 5000 files\n"
+    )
+
+    ap = argparse.ArgumentParser(description=description, epilog=epilog, formatter_class=argparse.RawTextHelpFormatter)
+    ap.add_argument("-c","--count", help="number of files to create", type=int, default=2000)
+    ap.add_argument("-s","--seed", help="random seed (same seed makes same files)", type=int, default=1)
+    ap.add_argument("-r","--repeat", help="times each CLI over the corpus N times and keeps the best", type=int, default=3)
+    ap.add_argument("-po","--performance-new", help="only time new CLI", action='store_true')
+    ap.add_argument("-cn","--cli-new", help="sets name of new CLI (can be a path)", default=DEFAULT_CLI_NEW)
+    ap.add_argument("-co","--cli-old", help="sets name of old CLI (can be a path)", default=DEFAULT_CLI_OLD)
+    ap.add_argument("-nd","--no-delete", help="don't delete created files", action='store_true')
+    ap.add_argument("-ds","--detect-source", help="sets path of detect.c", default=DETECT_SOURCE)
+
+    args = ap.parse_args()
+    return args
+
+###############################################################################
+
+# reads declared header IDs and extensions from the declaration table
+def read_declarations(path):
+    ids = set()
+    exts = set()
+    with open(path, 'r') as f:
+        for line in f:
+            match = re.match(r'\s*\{ init_vgmstream_\w+, (NULL|"([^"]*)")(, \d+, \{ ([^}]*) \})? \},', line)
+            if not match:
+                continue
+            if match.group(2) is not None:
+                exts.update(match.group(2).split(','))
+            if match.group(4):
+                ids.update(int(id, 16) for id in match.group(4).split(','))
+    return sorted(ids), sorted(exts)
+
+def create_corpus(path, count, seed, ids, exts):
+    rng = random.Random(seed)
+    # some common extensions with no declared ID, to reach undeclared metas too
+    exts = exts + ['bin', 'dat', 'snd', 'wav', 'str', '']
+
+    files = []
+    for i in range(count):
+        kind = i % 3
+        size = rng.randint(0x40, 0x800)
+        if kind == 0 and ids:       # declared ID + random extension
+            data = rng.choice(ids).to_bytes(4, 'big') + bytes(rng.getrandbits(8) for _ in range(size - 4))
+        elif kind == 1:             # random data
+            data = bytes(rng.getrandbits(8) for _ in range(size))
+        else:                       # mostly zero header with some values
+            data = bytearray(size)
+            for _ in range(8):
+                data[rng.randrange(size)] = rng.getrandbits(8)
+            data = bytes(data)
+
+        ext = rng.choice(exts)
+        name = os.path.join(path, 'detect_%05i%s' % (i, '.' + ext if ext else ''))
+        with open(name, 'wb') as f:
+            f.write(data)
+        files.append(name)
+    return files
+
+# returns best time and detected files (metadata output) per file
+def time_cli(cli, files, repeat):
+    best = None
+    output = None
+    skipped = 0
+    for _ in range(max(repeat, 1)):
+        elapsed = 0
+        output = {}
+        skipped = 0
+        for i in range(0, len(files), FILES_PER_CALL):
+            chunk = files[i:i + FILES_PER_CALL]
+            start = time.perf_counter()
+            try:
+                res = subprocess.run([cli, '-m'] + chunk, stdout=subprocess.PIPE, stderr=subprocess.DEVNULL, timeout=CALL_TIMEOUT)
+            except subprocess.TimeoutExpired:
+                skipped += len(chunk)
+                continue
+            elapsed += time.perf_counter() - start
+
+            current = None
+            for line in res.stdout.decode('utf-8', errors='replace').splitlines():
+                if line.startswith('metadata for '):
+                    current = line[len('metadata for '):]
+                    output[current] = []
+                elif current:
+                    output[current].append(line)
+        if best is None or elapsed < best:
+            best = elapsed
+    return best, output, skipped
+
+def print_time(name, elapsed, files, skipped):
+    timed = max(files - skipped, 1)
+    print("%s: %.3fs for %i files (%.3fms per file)%s" % (name, elapsed, timed, elapsed * 1000.0 / timed, ", %i skipped" % (skipped) if skipped else ""))
+
+###############################################################################
+
+def main():
+    args = parse_args()
+    if not args:
+        return
+
+    ids, exts = read_declarations(args.detect_source)
+    print("declarations: %i IDs, %i extensions" % (len(ids), len(exts)))
+
+    path = tempfile.mkdtemp(prefix='detect_bench_')
+    try:
+        files = create_corpus(path, args.count, args.seed, ids, exts)
+        print("created %i files in %s" % (len(files), path))
+
+        time_new, output_new, skipped_new = time_cli(args.cli_new, files, args.repeat)
+        print_time("new", time_new, len(files), skipped_new)
+        print("detected: %i" % (len(output_new)))
+
+        if not args.performance_new:
+            time_old, output_old, skipped_old = time_cli(args.cli_old, files, args.repeat)
+            print_time("old", time_old, len(files), skipped_old)
+
+            diffs = [name for name in set(output_new) | set(output_old) if output_new.get(name) != output_old.get(name)]
+            for name in sorted(diffs):
+                print("diffs: %s" % (name))
+            if time_new:
+                print("old/new: %.2fx, %i diffs" % (time_old / time_new, len(diffs)))
+    finally:
+        if args.no_delete:
+            print("kept files in %s" % (path))
+        else:
+            shutil.rmtree(path)
+
+
+if __name__ == "__main__":
+    main()
@@ -93,6 +93,9 @@ static void usage(const char* progname, int is_help) {
             "    -T: print title (for title testing)\n"
             "    -D <max channels>: downmix to <max channels> (for plugin downmix testing)\n"
             "    -O: decode but don't write to file (for performance testing)\n"
+            "    -B <index>: build or refresh metadata index <index> with the input files\n"
+            "       (unchanged files already in <index> aren't detected again)\n"
+            "    -U <index>: open files using metadata index <index> made with -B\n"
     );
 
 }
@@ -138,6 +141,8 @@ typedef struct {
     int decode_only;
     int show_title;
     int downmix_channels;
+    const char* index_build_filename;
+    const char* index_filename;
 
     /* not quite config but eh */
     int lwav_loop_start;
@@ -163,7 +168,7 @@ static int parse_config(cli_config* cfg, int argc, char** argv) {
     optind = 1; /* reset getopt's ugly globals (needed in wasm that may call same main() multiple times) */
 
     /* read config */
-    while ((opt = getopt(argc, argv, "o:l:f:d:ipPcmxeLEFrgb2:s:tTk:K:hOvD:S:"
+    while ((opt = getopt(argc, argv, "o:l:f:d:ipPcmxeLEFrgb2:s:tTk:K:hOvD:S:B:U:"
 #ifdef HAVE_JSON
         "VI"
 #endif
@@ -257,6 +262,12 @@ static int parse_config(cli_config* cfg, int argc, char** argv) {
             case 'D':
                 cfg->downmix_channels = atoi(optarg);
                 break;
+            case 'B':
+                cfg->index_build_filename = optarg;
+                break;
+            case 'U':
+                cfg->index_filename = optarg;
+                break;
             case 'h':
                 usage(argv[0], 1);
                 goto fail;
@@ -586,11 +597,13 @@ static void replace_filename(char* dst, size_t dstsize, cli_config* cfg, VGMSTRE
 
 static int convert_file(cli_config* cfg);
 static int convert_subsongs(cli_config* cfg);
+static int build_index(cli_config* cfg);
 static int write_file(VGMSTREAM* vgmstream, cli_config* cfg);
 
 
 int main(int argc, char** argv) {
     cli_config cfg = {0};
+    vgmstream_index_t* index = NULL;
     int i, res, ok;
 
 
@@ -608,6 +621,23 @@ int main(int argc, char** argv) {
     res = validate_config(&cfg);
     if (!res) goto fail;
 
+    if (cfg.index_build_filename) {
+        res = build_index(&cfg);
+        if (!res) goto fail;
+        return EXIT_SUCCESS;
+    }
+
+    if (cfg.index_filename) {
+        STREAMFILE* sf_index = open_stdio_streamfile(cfg.index_filename);
+        index = vgmstream_index_load(sf_index);
+        close_streamfile(sf_index);
+        if (!index) {
+            fprintf(stderr, "failed to load index %s\n", cfg.index_filename);
+            goto fail;
+        }
+        vgmstream_index_set(index);
+    }
+
     ok = 0;
     for (i = 0; i < cfg.infilenames_count; i++) {
         /* current name, to avoid passing params all the time */
@@ -627,6 +657,8 @@ int main(int argc, char** argv) {
         }
     }
 
+    vgmstream_index_close(index);
+
     /* ok if at least one succeeds, for programs that check result code */
     if (!ok)
         goto fail;
@@ -636,6 +668,69 @@ fail:
     return EXIT_FAILURE;
 }
 
+/* detects all input files into the index, reusing entries of the current one */
+static int build_index(cli_config* cfg) {
+    vgmstream_index_t* old_index = NULL;
+    vgmstream_index_t* index = NULL;
+    STREAMFILE* sf_index = NULL;
+    uint8_t* buf = NULL;
+    size_t buf_size;
+    FILE* outfile = NULL;
+    int i, detected = 0, unchanged = 0, unsupported = 0;
+
+    /* a missing or invalid index is just rebuilt */
+    sf_index = open_stdio_streamfile(cfg->index_build_filename);
+    if (sf_index) {
+        old_index = vgmstream_index_load(sf_index);
+        close_streamfile(sf_index);
+    }
+
+    index = vgmstream_index_init();
+    if (!index) goto fail;
+
+    for (i = 0; i < cfg->infilenames_count; i++) {
+        STREAMFILE* sf = open_stdio_streamfile(cfg->infilenames[i]);
+        int res = vgmstream_index_update(index, sf, old_index);
+        close_streamfile(sf);
+
+        if (res == 1)
+            detected++;
+        else if (res == 2)
+            unchanged++;
+        else
+            unsupported++;
+    }
+
+    buf_size = vgmstream_index_write(index, NULL, 0);
+    buf = malloc(buf_size);
+    if (!buf) goto fail;
+    vgmstream_index_write(index, buf, buf_size);
+
+    outfile = fopen(cfg->index_build_filename, "wb");
+    if (!outfile) {
+        fprintf(stderr, "failed to open %s for output\n", cfg->index_build_filename);
+        goto fail;
+    }
+    if (fwrite(buf, 1, buf_size, outfile) != buf_size) {
+        fprintf(stderr, "failed to write %s\n", cfg->index_build_filename);
+        goto fail;
+    }
+
+    printf("index %s: %i detected, %i unchanged, %i not supported\n", cfg->index_build_filename, detected, unchanged, unsupported);
+
+    fclose(outfile);
+    free(buf);
+    vgmstream_index_close(index);
+    vgmstream_index_close(old_index);
+    return 1;
+fail:
+    if (outfile) fclose(outfile);
+    free(buf);
+    vgmstream_index_close(index);
+    vgmstream_index_close(old_index);
+    return 0;
+}
+
 static int convert_subsongs(cli_config* cfg) {
     int res, kos;
     int subsong;
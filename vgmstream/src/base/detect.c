@@ -0,0 +1,658 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "detect.h"
+#include "../meta/meta.h"
+#include "../util.h"
+#include "../util/sf_utils.h"
+
+/* the index is built once by whichever thread opens a file first, and published with a compare-exchange */
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#define index_load(p)               InterlockedCompareExchangePointer((PVOID volatile*)(p), NULL, NULL)
+#define index_publish(p, index)     (InterlockedCompareExchangePointer((PVOID volatile*)(p), (index), NULL) == NULL)
+#else
+#define index_load(p)               __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define index_publish(p, index)     __sync_bool_compare_and_swap((p), NULL, (index))
+#endif
+
+
+/* FORMAT DETECTION INDEX
+ * Most init functions start by checking a header ID at 0x00 and/or the extension and bail out right away.
+ * Trying ~500 of them in order means hundreds of failed probes (and name/header reads) for formats late in the list,
+ * so those leading checks are declared here and indexed once: the file's ID and extension are read a single time
+ * and only functions whose declaration matches (plus all undeclared ones) are called, still in table order.
+ *
+ * Declarations must only include checks the init function does before anything else, so skipping a function
+ * never changes which one accepts a file (update them when those checks change). Functions not listed here are
+ * always tried. cli/tools/detect_bench.py times detection over synthetic files using this table. */
+
+#define DETECT_MAX_IDS  5
+#define DETECT_MAX_EXT  16   /* longer extensions can't match any declared one */
+
+typedef struct {
+    init_vgmstream_t init;
+    const char* extensions;         /* one of these is required (same list passed to check_extensions), or NULL */
+    int id_count;
+    uint32_t ids[DETECT_MAX_IDS];   /* one of these is required at 0x00 (read as BE) */
+} detect_decl_t;
+
+static const detect_decl_t detect_decls[] = {
+    { init_vgmstream_brstm, "brstm,brstmspm", 1, { 0x5253544D } }, /* "RSTM" */
+    { init_vgmstream_brwav, "brwav,rwav", 1, { 0x52574156 } }, /* "RWAV" */
+    { init_vgmstream_bfwav, "bfwav,fwav", 1, { 0x46574156 } }, /* "FWAV" */
+    { init_vgmstream_bcwav, "bcwav,adpcm,bms,sfx,str,zic", 1, { 0x43574156 } }, /* "CWAV" */
+    { init_vgmstream_brwar, "rwar", 1, { 0x52574152 } }, /* "RWAR" */
+    { init_vgmstream_nds_strm, "strm", 1, { 0x5354524D } }, /* "STRM" */
+    { init_vgmstream_afc, "afc,stx" },
+    { init_vgmstream_rs03, "dsp" },
+    { init_vgmstream_csmp, "csmp", 1, { 0x43534D50 } }, /* "CSMP" */
+    { init_vgmstream_cstr, "dsp", 1, { 0x43737472 } }, /* "Cstr" */
+    { init_vgmstream_gcsw, "gcw" },
+    { init_vgmstream_ads, "ads,ss2,pcm,adx,,800", 1, { 0x53536864 } }, /* "SShd" */
+    { init_vgmstream_npsf, "nps,npsf", 1, { 0x4E505346 } }, /* "NPSF" */
+    { init_vgmstream_exst, "sts,sts_cp3,x", 1, { 0x45585354 } }, /* "EXST" */
+    { init_vgmstream_svag_kcet, "svag" },
+    { init_vgmstream_ngc_mpdsp, "mpdsp,ste" },
+    { init_vgmstream_ngc_dsp_std_int, "dsp,mss,gcm" },
+    { init_vgmstream_vag_aaap, "vag", 1, { 0x41414170 } }, /* "AAAp" */
+    { init_vgmstream_ngc_str, "str", 1, { 0xFAAF0001 } },
+    { init_vgmstream_ea_schl, "asf,lasf,str,chk,eam,exa,sng,aud,sx,xa,strm,stm,hab,xsf,gsf,,r" },
+    { init_vgmstream_caf, "caf,cfn," },
+    { init_vgmstream_vpk, "vpk" },
+    { init_vgmstream_genh, "genh", 1, { 0x47454E48 } }, /* "GENH" */
+    { init_vgmstream_sfl_ogg, "sfl" },
+    { init_vgmstream_sadb, "sad", 1, { 0x73616462 } }, /* "sadb" */
+    { init_vgmstream_ps2_bmdx, "bmdx" },
+    { init_vgmstream_wsi, "wsi" },
+    { init_vgmstream_aifc, NULL, 1, { 0x464F524D } }, /* "FORM" */
+    { init_vgmstream_str_snds, "str,stream,3do", 3, { 0x4354524C, 0x534E4453, 0x53484452 } }, /* "CTRL" "SNDS" "SHDR" */
+    { init_vgmstream_ws_aud, "aud" },
+    { init_vgmstream_riff, NULL, 1, { 0x52494646 } }, /* "RIFF" */
+    { init_vgmstream_rifx, "wav,lwav", 1, { 0x52494658 } }, /* "RIFX" */
+    { init_vgmstream_nwa, "nwa" },
+    { init_vgmstream_hgc1, NULL, 1, { 0x68674331 } }, /* "hgC1" */
+    { init_vgmstream_aus, "aus", 1, { 0x41555320 } }, /* "AUS " */
+    { init_vgmstream_rws, NULL, 1, { 0x0D080000 } },
+    { init_vgmstream_fsb5, "fsb,snd", 1, { 0x46534235 } }, /* "FSB5" */
+    { init_vgmstream_rwax, "rwx", 1, { 0x52415758 } }, /* "RAWX" */
+    { init_vgmstream_ps2_xa30, "xa,xa30" },
+    { init_vgmstream_musc, "mus,musc", 1, { 0x4D555343 } }, /* "MUSC" */
+    { init_vgmstream_musx, "sfx,musx", 1, { 0x4D555358 } }, /* "MUSX" */
+    { init_vgmstream_filp, "fil", 1, { 0x46494C70 } }, /* "FILp" */
+    { init_vgmstream_ster, "ster,sfs", 1, { 0x53544552 } }, /* "STER" */
+    { init_vgmstream_bg00, "bg00", 1, { 0x42473030 } }, /* "BG00" */
+    { init_vgmstream_sat_dvi, "pcm,dvi", 1, { 0x4456492E } }, /* "DVI." */
+    { init_vgmstream_dc_kcey, "pcm,kcey" },
+    { init_vgmstream_rstm_rockstar, "rsm,rstm", 1, { 0x5253544D } }, /* "RSTM" */
+    { init_vgmstream_acm, "acm,tun,wavc", 2, { 0x97280301, 0x57415643 } },
+    { init_vgmstream_mus_acm, "mus" },
+    { init_vgmstream_vig_kces, "vig", 1, { 0x01006408 } },
+    { init_vgmstream_vsv, "vsv,psh" },
+    { init_vgmstream_ps2_pcm, "pcm" },
+    { init_vgmstream_ps2_rkv, "rkv" },
+    { init_vgmstream_lp_ap_lep, "bin,lbin,lp,lep,ap", 3, { 0x4C502020, 0x41502020, 0x4C455020 } }, /* "LP  " "AP  " "LEP " */
+    { init_vgmstream_sdt, "sdt" },
+    { init_vgmstream_aix, "aix", 1, { 0x41495846 } }, /* "AIXF" */
+    { init_vgmstream_wvs_xbox, "wvs" },
+    { init_vgmstream_wvs_ngc, "wvs" },
+    { init_vgmstream_dec, "dec,de2" },
+    { init_vgmstream_vs, "vs", 1, { 0xC8000000 } },
+    { init_vgmstream_xmu, "xmu", 1, { 0x584D5520 } }, /* "XMU " */
+    { init_vgmstream_xvas, "xvas" },
+    { init_vgmstream_sat_sap, "sap" },
+    { init_vgmstream_dc_idvi, "dvi,idvi" },
+    { init_vgmstream_idsp_tt, "gcm,idsp,wua", 1, { 0x49445350 } }, /* "IDSP" */
+    { init_vgmstream_omu, "omu", 1, { 0x4F4D5520 } }, /* "OMU " */
+    { init_vgmstream_idsp_nl, "idsp", 1, { 0x49445350 } }, /* "IDSP" */
+    { init_vgmstream_idsp_ie, "idsp" },
+    { init_vgmstream_sadl, "sad", 1, { 0x7361646C } }, /* "sadl" */
+    { init_vgmstream_fag, "fag" },
+    { init_vgmstream_mic, "mic," },
+    { init_vgmstream_ngc_pdt_split, "pdt" },
+    { init_vgmstream_ngc_pdt, "pdt" },
+    { init_vgmstream_spsd, "str,spsd", 1, { 0x53505344 } }, /* "SPSD" */
+    { init_vgmstream_bgw, "bgw" },
+    { init_vgmstream_spw, "spw" },
+    { init_vgmstream_ps2_ass, "ass" },
+    { init_vgmstream_ubi_jade, NULL, 1, { 0x52494646 } }, /* "RIFF" */
+    { init_vgmstream_nds_strm_ffta2, "bin,strm" },
+    { init_vgmstream_knon, "str,asr", 1, { 0x4B4E4F4E } }, /* "KNON" */
+    { init_vgmstream_gca, "gca", 1, { 0x47434131 } }, /* "GCA1" */
+    { init_vgmstream_spt_spd, "spd" },
+    { init_vgmstream_ish_isd, "isd" },
+    { init_vgmstream_gsnd, "gsp", 1, { 0x47534E44 } }, /* "GSND" */
+    { init_vgmstream_ydsp, "ydsp", 1, { 0x59445350 } }, /* "YDSP" */
+    { init_vgmstream_ps2_joe, "joe" },
+    { init_vgmstream_vgs, "vgs", 1, { 0x56675321 } }, /* "VgS!" */
+    { init_vgmstream_dcs_wav, "dcs" },
+    { init_vgmstream_mul, "mul,emff" },
+    { init_vgmstream_thp, "thp,dsp,mov," },
+    { init_vgmstream_p2bt_move_visa, "p2bt,move,vis", 3, { 0x50324254, 0x4D4F5645, 0x56495341 } }, /* "P2BT" "MOVE" "VISA" */
+    { init_vgmstream_gbts, "gbts", 1, { 0x47625473 } }, /* "GbTs" */
+    { init_vgmstream_ngc_dsp_iadp, "adp,iadp", 1, { 0x69616470 } }, /* "iadp" */
+    { init_vgmstream_aax, "aax,", 1, { 0x40555446 } }, /* "@UTF" */
+    { init_vgmstream_utf_dsp, "aax,", 1, { 0x40555446 } }, /* "@UTF" */
+    { init_vgmstream_sat_baka, ",baka", 1, { 0x42414B41 } }, /* "BAKA" */
+    { init_vgmstream_swav, "swav,adpcm", 1, { 0x53574156 } }, /* "SWAV" */
+    { init_vgmstream_vsf, "vsf" },
+    { init_vgmstream_nds_rrds, ",rrds" },
+    { init_vgmstream_ads_midway, "ads", 1, { 0x64685353 } }, /* "dhSS" */
+    { init_vgmstream_vgs_ps, "vgs" },
+    { init_vgmstream_nds_hwas, "hwas" },
+    { init_vgmstream_ps2_snd, "snd" },
+    { init_vgmstream_naomi_adpcm, "adpcm" },
+    { init_vgmstream_sd9, "sd9" },
+    { init_vgmstream_2dx9, "2dx9" },
+    { init_vgmstream_gcub, "wav,lwav,gcub", 1, { 0x47437562 } }, /* "GCub" */
+    { init_vgmstream_maxis_xa, "xa" },
+    { init_vgmstream_ngc_sck_dsp, "dsp" },
+    { init_vgmstream_apple_caff, NULL, 1, { 0x63616666 } }, /* "caff" */
+    { init_vgmstream_sab, "sab", 3, { 0x43535732, 0x43535032, 0x43535832 } }, /* "CSW2" "CSP2" "CSX2" */
+    { init_vgmstream_bns, "bin,lbin,bns" },
+    { init_vgmstream_wii_was, "was,dsp,isws", 1, { 0x69535753 } }, /* "iSWS" */
+    { init_vgmstream_pona_3do, "pona,sxd" },
+    { init_vgmstream_pona_psx, "pona" },
+    { init_vgmstream_myspd, "myspd" },
+    { init_vgmstream_dmsg, "sgt,dmsg", 1, { 0x52494646 } }, /* "RIFF" */
+    { init_vgmstream_ngc_dsp_aaap, "dsp", 1, { 0x41414170 } }, /* "AAAp" */
+    { init_vgmstream_wb, NULL, 1, { 0x00000000 } },
+    { init_vgmstream_bnsf, "bnsf", 1, { 0x424E5346 } }, /* "BNSF" */
+    { init_vgmstream_smpl, "v0,v1", 1, { 0x534D504C } }, /* "SMPL" */
+    { init_vgmstream_dsp_ddsp, "adp,ddsp,wav,lwav," },
+    { init_vgmstream_ngc_dsp_mpds, "dsp,mds" },
+    { init_vgmstream_dsp_str_ig, "str" },
+    { init_vgmstream_dsp_xiii, "dsp" },
+    { init_vgmstream_dsp_cabelas, "dsp" },
+    { init_vgmstream_lpcm_shade, "w,lpcm", 1, { 0x4C50434D } }, /* "LPCM" */
+    { init_vgmstream_dsp_dspw, "dspw", 1, { 0x44535057 } }, /* "DSPW" */
+    { init_vgmstream_jstm, "stm,jstm" },
+    { init_vgmstream_cps, "cps", 1, { 0x43505320 } }, /* "CPS " */
+    { init_vgmstream_baf, "baf", 1, { 0x42414E4B } }, /* "BANK" */
+    { init_vgmstream_msf, "msf,msa,at3,mp3,str,snd" },
+    { init_vgmstream_wii_ras, "ras" },
+    { init_vgmstream_spm, "spm" },
+    { init_vgmstream_ps2_iab, "iab" },
+    { init_vgmstream_vs_str, "vs,str" },
+    { init_vgmstream_xwav_new, "xwv,vawx", 1, { 0x56415758 } }, /* "VAWX" */
+    { init_vgmstream_xwav_old, "xwv", 1, { 0x58574156 } }, /* "XWAV" */
+    { init_vgmstream_psnd, "psn", 1, { 0x50534E44 } }, /* "PSND" */
+    { init_vgmstream_adp_wildfire, "adp", 1, { 0x41445021 } }, /* "ADP!" */
+    { init_vgmstream_adp_qd, "adp" },
+    { init_vgmstream_mtaf, "mtaf" },
+    { init_vgmstream_alp, "tun,pcm", 1, { 0x414C5020 } }, /* "ALP " */
+    { init_vgmstream_mss, "mss" },
+    { init_vgmstream_ivag, "ivag" },
+    { init_vgmstream_2pfs, "sap", 1, { 0x32504653 } }, /* "2PFS" */
+    { init_vgmstream_ps2_vbk, "vbk" },
+    { init_vgmstream_bcstm, "bcstm" },
+    { init_vgmstream_idsp_namco, "idsp", 1, { 0x49445350 } }, /* "IDSP" */
+    { init_vgmstream_mca, "mca" },
+    { init_vgmstream_ktss, "kns,kno,ktss", 1, { 0x4B545353 } }, /* "KTSS" */
+    { init_vgmstream_svag_snk, "svag" },
+    { init_vgmstream_ps2_vds_vdm, "vds,vdm" },
+    { init_vgmstream_cxs, "cxs", 1, { 0x43585320 } }, /* "CXS " */
+    { init_vgmstream_adx_monster, "adx", 1, { 0x02000000 } },
+    { init_vgmstream_akb, "akb", 1, { 0x414B4220 } }, /* "AKB " */
+    { init_vgmstream_akb2, "akb", 1, { 0x414B4232 } }, /* "AKB2" */
+    { init_vgmstream_astb, "ast", 1, { 0x41535442 } }, /* "ASTB" */
+    { init_vgmstream_pasx, "past,sgb", 1, { 0x50415358 } }, /* "PASX" */
+    { init_vgmstream_xma, "xma,xma2,wav,lwav,nps,str,kmx", 1, { 0x52494646 } }, /* "RIFF" */
+    { init_vgmstream_sndx, "sxd,sxd2,sxd3" },
+    { init_vgmstream_mc3, "mc3" },
+    { init_vgmstream_ghs, "gtd", 1, { 0x47485320 } }, /* "GHS " */
+    { init_vgmstream_aac_triace, "aac,laac", 2, { 0x41414320, 0x20434141 } }, /* "AAC " " CAA" */
+    { init_vgmstream_va3, "va3" },
+    { init_vgmstream_mta2, "mta2" },
+    { init_vgmstream_mta2_container, "dbm,bgm,mta2" },
+    { init_vgmstream_xa_xa30, "xa,xa30,e4x" },
+    { init_vgmstream_xa_04sw, "xa", 1, { 0x30345357 } }, /* "04SW" */
+    { init_vgmstream_ea_bnk, "bnk,sdt,hdt,ldt,abk,ast,cat," },
+    { init_vgmstream_ea_hdr_dat, "hdr" },
+    { init_vgmstream_ea_hdr_dat_v2, "hdr" },
+    { init_vgmstream_ea_map_mus, "map,lin,mpf", 1, { 0x50464478 } }, /* "PFDx" */
+    { init_vgmstream_ea_mpf_mus, "mpf" },
+    { init_vgmstream_ea_schl_fixed, "asf,lasf,cnk", 1, { 0x5343486C } }, /* "SCHl" */
+    { init_vgmstream_sk_aud, "aud" },
+    { init_vgmstream_ea_snu, "snu" },
+    { init_vgmstream_opus_std, "opus,lopus,bgm,opu,ogg,logg", 1, { 0x01000080 } },
+    { init_vgmstream_opus_capcom, "opus,lopus" },
+    { init_vgmstream_opus_nus3, "opus,lopus", 1, { 0x4F505553 } }, /* "OPUS" */
+    { init_vgmstream_opus_sps_n1, "sps,nlsd,at9,opus,lopus", 1, { 0x09000000 } },
+    { init_vgmstream_pc_ast, "ast" },
+    { init_vgmstream_naac, "naac", 1, { 0x41414320 } }, /* "AAC " */
+    { init_vgmstream_ezw, "ezw" },
+    { init_vgmstream_vxn, "vxn", 1, { 0x566F784E } }, /* "VoxN" */
+    { init_vgmstream_ea_snr_sns, "snr" },
+    { init_vgmstream_ea_mpf_mus_eaac, "mpf" },
+    { init_vgmstream_flx, "flx" },
+    { init_vgmstream_kma9, "km9" },
+    { init_vgmstream_xwc, "xwc" },
+    { init_vgmstream_atsl, "atsl,atsl3,atsl4,atslx", 1, { 0x4154534C } }, /* "ATSL" */
+    { init_vgmstream_atx, "atx" },
+    { init_vgmstream_wave, "wave", 5, { 0x56415733, 0x57574156, 0xFEECB7E5, 0xE5B7ECFE, 0xC9FB0C03 } },
+    { init_vgmstream_smv, "smv" },
+    { init_vgmstream_nxap, "adp" },
+    { init_vgmstream_ea_wve_au00, "wve,fsv" },
+    { init_vgmstream_ea_wve_ad10, "wve,mov" },
+    { init_vgmstream_sthd, "stx", 1, { 0x53544844 } }, /* "STHD" */
+    { init_vgmstream_pcm_sre, "pcm" },
+    { init_vgmstream_dsp_mcadpcm, "mcadpcm" },
+    { init_vgmstream_ubi_lyn, NULL, 1, { 0x52494646 } }, /* "RIFF" */
+    { init_vgmstream_ubi_lyn_container, "sns,wav,lwav,son" },
+    { init_vgmstream_msb_msh, "msb" },
+    { init_vgmstream_txtp, "txtp" },
+    { init_vgmstream_smc_smh, "smc" },
+    { init_vgmstream_ppst, "sng" },
+    { init_vgmstream_dsp_switch_audio, "switch_audio,dsp" },
+    { init_vgmstream_sadf, "sad,nop," },
+    { init_vgmstream_xmd, "xmd" },
+    { init_vgmstream_cks, "cks", 1, { 0x636B6D6B } }, /* "ckmk" */
+    { init_vgmstream_ckb, "ckb", 1, { 0x636B6D6B } }, /* "ckmk" */
+    { init_vgmstream_wv6, "wv6" },
+    { init_vgmstream_str_wav, "str,data" },
+    { init_vgmstream_hd3_bd3, "hd3", 1, { 0x50334844 } }, /* "P3HD" */
+    { init_vgmstream_nus3bank, "nub2,nus3bank", 1, { 0x4E555333 } }, /* "NUS3" */
+    { init_vgmstream_sscf, "scd", 1, { 0x53534346 } }, /* "SSCF" */
+    { init_vgmstream_dsp_sps_n1, "vag,nlsd", 1, { 0x08000000 } },
+    { init_vgmstream_dsp_itl_ch, "itl" },
+    { init_vgmstream_a2m, "int" },
+    { init_vgmstream_ahv, "ahv" },
+    { init_vgmstream_msv, "msv,msvp", 1, { 0x4D535670 } }, /* "MSVp" */
+    { init_vgmstream_sdf, "sdf" },
+    { init_vgmstream_svg, "svg" },
+    { init_vgmstream_vai, "vai" },
+    { init_vgmstream_apc, NULL, 1, { 0x4352594F } }, /* "CRYO" */
+    { init_vgmstream_wv2, "wv2" },
+    { init_vgmstream_xau_konami, "xau" },
+    { init_vgmstream_derf, "adp" },
+    { init_vgmstream_utk, "utk" },
+    { init_vgmstream_nxa1, "nxa", 1, { 0x4E584131 } }, /* "NXA1" */
+    { init_vgmstream_adpcm_capcom, "adpcm,mca" },
+    { init_vgmstream_ue4opus, "opus,lopus,ue4opus" },
+    { init_vgmstream_xwma, NULL, 1, { 0x52494646 } }, /* "RIFF" */
+    { init_vgmstream_xopus, "xopus", 1, { 0x584F7075 } }, /* "XOpu" */
+    { init_vgmstream_vs_square, "vs" },
+    { init_vgmstream_nwav, "nwav,", 1, { 0x4E574156 } }, /* "NWAV" */
+    { init_vgmstream_xpcm, "pcm" },
+    { init_vgmstream_msf_tamasoft, "msf" },
+    { init_vgmstream_xps_dat, "xps" },
+    { init_vgmstream_xps, "xps" },
+    { init_vgmstream_opus_opusx, "opusx", 1, { 0x4F505553 } }, /* "OPUS" */
+    { init_vgmstream_dsp_adpy, "adpcmx", 1, { 0x41445059 } }, /* "ADPY" */
+    { init_vgmstream_dsp_adpx, "adpcmx", 1, { 0x41445058 } }, /* "ADPX" */
+    { init_vgmstream_ogg_opus, "opus,lopus,ogg,logg,bgm", 1, { 0x4F676753 } }, /* "OggS" */
+    { init_vgmstream_nus3audio, NULL, 1, { 0x4E555333 } }, /* "NUS3" */
+    { init_vgmstream_imc, "imc" },
+    { init_vgmstream_imc_container, "imc" },
+    { init_vgmstream_gin, "gin", 2, { 0x476E7375, 0x4F63746E } }, /* "Gnsu" "Octn" */
+    { init_vgmstream_208, "208" },
+    { init_vgmstream_dsp_lucasarts_ds2, "ds2,dsp" },
+    { init_vgmstream_ffdl, "ogg,logg,mp4,lmp4,bin,lbin,", 2, { 0x4646444C, 0x6D747873 } }, /* "FFDL" "mtxs" */
+    { init_vgmstream_strm_abylight, "strm", 1, { 0x5354524D } }, /* "STRM" */
+    { init_vgmstream_msf_konami, "msf", 1, { 0x4D534643 } }, /* "MSFC" */
+    { init_vgmstream_xwma_konami, "xwma", 1, { 0x58574D41 } }, /* "XWMA" */
+    { init_vgmstream_9tav, "9tav" },
+    { init_vgmstream_fsb5_fev_bank, NULL, 1, { 0x52494646 } }, /* "RIFF" */
+    { init_vgmstream_bwav, "bwav", 1, { 0x42574156 } }, /* "BWAV" */
+    { init_vgmstream_opus_prototype, "opus,lopus", 1, { 0x4F505553 } }, /* "OPUS" */
+    { init_vgmstream_acb, NULL, 1, { 0x40555446 } }, /* "@UTF" */
+    { init_vgmstream_rad, "rad" },
+    { init_vgmstream_smk, "smk", 2, { 0x534D4B32, 0x534D4B34 } }, /* "SMK2" "SMK4" */
+    { init_vgmstream_mzrt_v0, NULL, 1, { 0x6D7A7274 } }, /* "mzrt" */
+    { init_vgmstream_xavs, "xav" },
+    { init_vgmstream_dsp_itl, "itl,dsp" },
+    { init_vgmstream_ima, "ima" },
+    { init_vgmstream_nub_xma, "xma" },
+    { init_vgmstream_nub_idsp, "idsp", 1, { 0x69647370 } }, /* "idsp" */
+    { init_vgmstream_xwv_valve, NULL, 1, { 0x58575620 } }, /* "XWV " */
+    { init_vgmstream_bmp_konami, "bin,lbin" },
+    { init_vgmstream_opus_sqex, "wav,lwav", 1, { 0x01000000 } },
+    { init_vgmstream_xssb, "bin,lbin", 1, { 0x58535342 } }, /* "XSSB" */
+    { init_vgmstream_csb, "csb", 1, { 0x40555446 } }, /* "@UTF" */
+    { init_vgmstream_fwse, "fwse" },
+    { init_vgmstream_fda, "fda" },
+    { init_vgmstream_kwb, "wbd,wb2,sed", 3, { 0x5742445F, 0x5F444257, 0x57484431 } }, /* "WBD_" "_DBW" "WHD1" */
+    { init_vgmstream_lrmd, NULL, 1, { 0x4C524D44 } }, /* "LRMD" */
+    { init_vgmstream_bkhd, "bnk" },
+    { init_vgmstream_diva, "diva" },
+    { init_vgmstream_ktsr, "ktsl2asbin,asbin", 1, { 0x4B545352 } }, /* "KTSR" */
+    { init_vgmstream_asrs, "srsa", 1, { 0x41535253 } }, /* "ASRS" */
+    { init_vgmstream_mups, "mups,", 1, { 0x4D555053 } }, /* "MUPS" */
+    { init_vgmstream_kat, "kat" },
+    { init_vgmstream_pcm_success, "pcm", 1, { 0x50434D20 } }, /* "PCM " */
+    { init_vgmstream_ktsc, "ktsl2asbin,asbin", 1, { 0x4B545343 } }, /* "KTSC" */
+    { init_vgmstream_adp_konami, "adp", 1, { 0x41445002 } },
+    { init_vgmstream_zwv, "zwv", 1, { 0x77617665 } }, /* "wave" */
+    { init_vgmstream_dsb, "dsb", 1, { 0x44535342 } }, /* "DSSB" */
+    { init_vgmstream_bsf, "bsf", 1, { 0x48465342 } }, /* "HFSB" */
+    { init_vgmstream_sdrh_new, "xse", 1, { 0x48524453 } }, /* "HRDS" */
+    { init_vgmstream_sdrh_old, "xse", 1, { 0x53445248 } }, /* "SDRH" */
+    { init_vgmstream_wady, "way,", 1, { 0x57414459 } }, /* "WADY" */
+    { init_vgmstream_dsp_sqex, "wav,lwav", 1, { 0x00000000 } },
+    { init_vgmstream_xws, "xws" },
+    { init_vgmstream_opus_nsopus, "nsopus", 1, { 0x45574E4F } }, /* "EWNO" */
+    { init_vgmstream_sbk, NULL, 1, { 0x52494646 } }, /* "RIFF" */
+    { init_vgmstream_dsp_cwac, "dsp", 1, { 0x43574143 } }, /* "CWAC" */
+    { init_vgmstream_ifs, "ifs", 1, { 0x6CAD8F89 } },
+    { init_vgmstream_acx, NULL, 1, { 0x00000000 } },
+    { init_vgmstream_compresswave, "cwav" },
+    { init_vgmstream_mzrt_v1, NULL, 1, { 0x6D7A7274 } }, /* "mzrt" */
+    { init_vgmstream_tac, ",aac,laac" },
+    { init_vgmstream_sspr, "sspr", 1, { 0x53535052 } }, /* "SSPR" */
+    { init_vgmstream_piff_tpcm, "tad" },
+    { init_vgmstream_wxd_wxh, "wxd", 1, { 0x57584431 } }, /* "WXD1" */
+    { init_vgmstream_bnk_relic, "bnk", 1, { 0x424E4B30 } }, /* "BNK0" */
+    { init_vgmstream_xsh_xsd_xss, "xsh" },
+    { init_vgmstream_lopu_fb, "lopus", 1, { 0x4C4F5055 } }, /* "LOPU" */
+    { init_vgmstream_lpcm_fb, "ladpcm", 1, { 0x4C50434D } }, /* "LPCM" */
+    { init_vgmstream_dsp_apex, "dsp", 1, { 0x41504558 } }, /* "APEX" */
+    { init_vgmstream_ubi_ckd_cwav, NULL, 1, { 0x52494646 } }, /* "RIFF" */
+    { init_vgmstream_sspf, "ssp", 1, { 0x53535046 } }, /* "SSPF" */
+    { init_vgmstream_opus_rsnd, "rsnd", 1, { 0x52534E44 } }, /* "RSND" */
+    { init_vgmstream_s3v, "s3v" },
+    { init_vgmstream_adm3, "wem,bnk", 1, { 0x41444D33 } }, /* "ADM3" */
+    { init_vgmstream_tt_ad, "audio_data", 1, { 0x464D5420 } }, /* "FMT " */
+    { init_vgmstream_bw_mp3_riff, NULL, 1, { 0xFFF360C4 } },
+    { init_vgmstream_bw_riff_mp3, NULL, 1, { 0x52494646 } }, /* "RIFF" */
+    { init_vgmstream_sndz, NULL, 1, { 0x534E445A } }, /* "SNDZ" */
+    { init_vgmstream_sscf_encrypted, "scd", 1, { 0x53534346 } }, /* "SSCF" */
+    { init_vgmstream_utf_ahx, "aax,", 1, { 0x40555446 } }, /* "@UTF" */
+    { init_vgmstream_ego_dic, "dic", 1, { 0x44494331 } }, /* "DIC1" */
+    { init_vgmstream_snds, NULL, 1, { 0x53534444 } }, /* "SSDD" */
+    { init_vgmstream_adm2, "wem", 1, { 0x41444D32 } }, /* "ADM2" */
+    { init_vgmstream_nxof, "nxopus", 1, { 0x666F786E } }, /* "foxn" */
+    { init_vgmstream_cbx, "cbx", 1, { 0x21423058 } }, /* "!B0X" */
+    { init_vgmstream_vas_rockstar, "vas", 2, { 0x56414773, 0x32414773 } }, /* "VAGs" "2AGs" */
+    { init_vgmstream_ea_sbk, "sbk", 2, { 0x73626E6B, 0x6B6E6273 } }, /* "sbnk" "knbs" */
+    { init_vgmstream_dsp_asura_ds2, "ds2" },
+    { init_vgmstream_dsp_asura_ttss, "adpcm,wav,lwav", 1, { 0x54545353 } }, /* "TTSS" */
+    { init_vgmstream_dsp_asura_sfx, "sfx" },
+    { init_vgmstream_scd_pcm, "pcm" },
+    { init_vgmstream_vas_kceo, "vas" },
+    { init_vgmstream_vas_kceo_container, "vas" },
+    { init_vgmstream_mib_mih, "mib" },
+    { init_vgmstream_mic_koei, "mic" },
+    { init_vgmstream_seb, "seb,gms," },
+    { init_vgmstream_rage_aud, ",ivaud" },
+    { init_vgmstream_dtk, "dtk,adp,trk,wav,lwav" },
+    { init_vgmstream_btsnd, "btsnd" },
+    { init_vgmstream_nus3bank_encrypted, "nus3bank,xma", 1, { 0x552AAF17 } },
+    { init_vgmstream_raw_rsf, "rsf" },
+    { init_vgmstream_raw_int, "int,wp2" },
+    { init_vgmstream_raw_snds, "snds" },
+    { init_vgmstream_raw_wavm, "wavm" },
+    { init_vgmstream_raw_pcm, "raw" },
+    { init_vgmstream_ps2_adm, "adm" },
+    { init_vgmstream_rwsd, "brwsd,rwsd", 1, { 0x52575344 } }, /* "RWSD" */
+};
+
+#define DETECT_DECL_COUNT ((int)(sizeof(detect_decls) / sizeof(detect_decls[0])))
+
+#define DETECT_ID   (1 << 0)
+#define DETECT_EXT  (1 << 1)
+
+typedef struct {
+    uint32_t id;
+    int index;
+} detect_id_t;
+
+typedef struct {
+    const char* ext;                /* points into the declared list, not null terminated */
+    int ext_len;
+    int index;
+} detect_ext_t;
+
+typedef struct {
+    detect_id_t* ids;               /* sorted by id then function index */
+    int ids_count;
+    detect_ext_t* exts;             /* sorted by extension then function index */
+    int exts_count;
+    int* open;                      /* undeclared function indexes, always candidates */
+    int open_count;
+    uint8_t* flags;                 /* DETECT_* requirements per function index */
+} detect_index_t;
+
+static detect_index_t* g_index = NULL; /* set once, never freed */
+
+
+static int cmp_decl(const void* a, const void* b) {
+    uintptr_t init_a = (uintptr_t)(*(const detect_decl_t**)a)->init;
+    uintptr_t init_b = (uintptr_t)(*(const detect_decl_t**)b)->init;
+    return init_a < init_b ? -1 : init_a > init_b ? 1 : 0;
+}
+
+static int cmp_ext(const char* ext_a, int len_a, const char* ext_b, int len_b) {
+    int cmp = memcmp(ext_a, ext_b, len_a < len_b ? len_a : len_b);
+    if (cmp)
+        return cmp;
+    return len_a - len_b;
+}
+
+static int cmp_id_entry(const void* a, const void* b) {
+    const detect_id_t* id_a = a;
+    const detect_id_t* id_b = b;
+    if (id_a->id != id_b->id)
+        return id_a->id < id_b->id ? -1 : 1;
+    return id_a->index - id_b->index;
+}
+
+static int cmp_ext_entry(const void* a, const void* b) {
+    const detect_ext_t* ext_a = a;
+    const detect_ext_t* ext_b = b;
+    int cmp = cmp_ext(ext_a->ext, ext_a->ext_len, ext_b->ext, ext_b->ext_len);
+    if (cmp)
+        return cmp;
+    return ext_a->index - ext_b->index;
+}
+
+static void add_extensions(detect_index_t* index, const char* extensions, int function_index) {
+    const char* ext = extensions;
+    for (;;) {
+        const char* comma = strchr(ext, ',');
+        int ext_len = comma ? (int)(comma - ext) : (int)strlen(ext);
+
+        index->exts[index->exts_count].ext = ext;
+        index->exts[index->exts_count].ext_len = ext_len;
+        index->exts[index->exts_count].index = function_index;
+        index->exts_count++;
+
+        if (!comma)
+            break;
+        ext = comma + 1;
+    }
+}
+
+static int build_index(detect_index_t* index, init_vgmstream_t* functions, int count) {
+    const detect_decl_t* decls[DETECT_DECL_COUNT];
+    int max_ids = 0, max_exts = 0;
+
+    /* sorted by function so each table entry finds its declaration quickly */
+    for (int i = 0; i < DETECT_DECL_COUNT; i++) {
+        const char* ext = detect_decls[i].extensions;
+        decls[i] = &detect_decls[i];
+        max_ids += detect_decls[i].id_count;
+        while (ext) {
+            max_exts++;
+            ext = strchr(ext, ',');
+            if (ext) ext++;
+        }
+    }
+    qsort(decls, DETECT_DECL_COUNT, sizeof(decls[0]), cmp_decl);
+
+    index->ids = malloc(max_ids * sizeof(detect_id_t));
+    index->exts = malloc(max_exts * sizeof(detect_ext_t));
+    index->open = malloc(count * sizeof(int));
+    index->flags = calloc(count, sizeof(uint8_t));
+    if (!index->ids || !index->exts || !index->open || !index->flags)
+        return 0;
+
+    for (int i = 0; i < count; i++) {
+        detect_decl_t key = { functions[i] };
+        const detect_decl_t* key_ptr = &key;
+        const detect_decl_t** found = bsearch(&key_ptr, decls, DETECT_DECL_COUNT, sizeof(decls[0]), cmp_decl);
+
+        if (!found) {
+            index->open[index->open_count++] = i;
+            continue;
+        }
+
+        for (int j = 0; j < (*found)->id_count; j++) {
+            index->ids[index->ids_count].id = (*found)->ids[j];
+            index->ids[index->ids_count].index = i;
+            index->ids_count++;
+            index->flags[i] |= DETECT_ID;
+        }
+
+        if ((*found)->extensions) {
+            add_extensions(index, (*found)->extensions, i);
+            index->flags[i] |= DETECT_EXT;
+        }
+    }
+
+    qsort(index->ids, index->ids_count, sizeof(detect_id_t), cmp_id_entry);
+    qsort(index->exts, index->exts_count, sizeof(detect_ext_t), cmp_ext_entry);
+    return 1;
+}
+
+static void free_index(detect_index_t* index) {
+    if (!index) return;
+    free(index->ids);
+    free(index->exts);
+    free(index->open);
+    free(index->flags);
+    free(index);
+}
+
+/* Global index, NULL if it can't be built. Threads opening their first file at the same time may each build one,
+ * but only the first to finish publishes it (the rest free theirs), so readers never see a partial index. */
+static const detect_index_t* get_index(init_vgmstream_t* functions, int count) {
+    detect_index_t* index = index_load(&g_index);
+    if (index)
+        return index;
+
+    index = calloc(1, sizeof(detect_index_t));
+    if (!index)
+        return NULL;
+    if (!build_index(index, functions, count)) {
+        free_index(index);
+        return NULL;
+    }
+
+    if (!index_publish(&g_index, index)) {
+        free_index(index);
+        index = index_load(&g_index);
+    }
+    return index;
+}
+
+/* first entry with id (or the end) */
+static int find_id(const detect_index_t* index, uint32_t id) {
+    int lo = 0, hi = index->ids_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (index->ids[mid].id < id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* first entry with ext (or the end) */
+static int find_ext(const detect_index_t* index, const char* ext, int ext_len) {
+    int lo = 0, hi = index->exts_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (cmp_ext(index->exts[mid].ext, index->exts[mid].ext_len, ext, ext_len) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+int detect_vgmstream_candidates(STREAMFILE* sf, init_vgmstream_t* functions, int count, int* candidates) {
+    char filename[PATH_LIMIT];
+    char ext[DETECT_MAX_EXT];
+    const char* file_ext;
+    int ext_len;
+    uint32_t id;
+    int id_pos, id_end, ext_pos, ext_end, ext_start, open_pos = 0;
+    int candidate_count = 0;
+    const detect_index_t* index;
+
+    index = get_index(functions, count);
+    if (!index)
+        return -1;
+
+    /* read what the declared checks need once */
+    id = read_u32be(0x00, sf);
+
+    get_streamfile_name(sf, filename, sizeof(filename));
+    file_ext = filename_extension(filename);
+    ext_len = strlen(file_ext);
+    if (ext_len < DETECT_MAX_EXT) {
+        for (int i = 0; i < ext_len; i++) {
+            ext[i] = tolower((unsigned char)file_ext[i]);
+        }
+    }
+    else {
+        ext_len = -1; /* can't match, empty ranges below */
+    }
+
+    id_pos = find_id(index, id);
+    id_end = id_pos;
+    while (id_end < index->ids_count && index->ids[id_end].id == id)
+        id_end++;
+
+    ext_start = ext_len < 0 ? index->exts_count : find_ext(index, ext, ext_len);
+    ext_end = ext_start;
+    while (ext_end < index->exts_count && cmp_ext(index->exts[ext_end].ext, index->exts[ext_end].ext_len, ext, ext_len) == 0)
+        ext_end++;
+    ext_pos = ext_start;
+
+    /* merge the three lists in table order, so the first function that accepts the file is the same as in a full scan */
+    for (;;) {
+        int next = count;
+
+        /* functions with an ID must also match their extensions, if declared */
+        while (id_pos < id_end && (index->flags[index->ids[id_pos].index] & DETECT_EXT)) {
+            int found = 0;
+            for (int i = ext_start; i < ext_end; i++) {
+                if (index->exts[i].index == index->ids[id_pos].index) {
+                    found = 1;
+                    break;
+                }
+            }
+            if (found)
+                break;
+            id_pos++;
+        }
+
+        /* functions with an ID are handled above */
+        while (ext_pos < ext_end && (index->flags[index->exts[ext_pos].index] & DETECT_ID))
+            ext_pos++;
+
+        if (open_pos < index->open_count && index->open[open_pos] < next)
+            next = index->open[open_pos];
+        if (id_pos < id_end && index->ids[id_pos].index < next)
+            next = index->ids[id_pos].index;
+        if (ext_pos < ext_end && index->exts[ext_pos].index < next)
+            next = index->exts[ext_pos].index;
+        if (next == count)
+            break;
+
+        candidates[candidate_count++] = next;
+
+        if (open_pos < index->open_count && index->open[open_pos] == next)
+            open_pos++;
+        while (id_pos < id_end && index->ids[id_pos].index == next)
+            id_pos++;
+        while (ext_pos < ext_end && index->exts[ext_pos].index == next)
+            ext_pos++;
+    }
+
+    return candidate_count;
+}
@@ -0,0 +1,14 @@
+#ifndef _DETECT_H
+#define _DETECT_H
+
+#include "../vgmstream.h"
+
+typedef VGMSTREAM* (*init_vgmstream_t)(STREAMFILE*);
+
+/* Writes the indexes of init functions that may accept the file into candidates (in table order) and returns
+ * how many there are, or -1 if the index couldn't be built and every function must be tried.
+ * Functions declare a header ID at 0x00 and/or extensions they require; undeclared ones are always candidates.
+ * The index is built on first use from the passed table, which must be the same on every call. */
+int detect_vgmstream_candidates(STREAMFILE* sf, init_vgmstream_t* functions, int count, int* candidates);
+
+#endif
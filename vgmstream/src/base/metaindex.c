@@ -0,0 +1,381 @@
+#include <stdlib.h>
+#include <string.h>
+#include "metaindex.h"
+#include "../coding/coding.h"
+#include "../util/reader_get.h"
+#include "../util/reader_put.h"
+#include "../util/sf_utils.h"
+
+
+/* METADATA INDEX
+ * Detection tries formats in order, and some formats then search their decryption key in a big list, so opening
+ * the same files on every run (a game's music and voices) repeats a lot of work. The index stores which init function
+ * accepted each file plus the resolved key, and init_vgmstream calls that function directly (reading the key from
+ * the probe SF). Anything odd (stale entry, changed file with same hash) just falls back to regular detection.
+ *
+ * File format (little endian):
+ * - 0x00: "VGMI"
+ * - 0x04: version
+ * - 0x08: number of init functions when made (entries are ignored if the table changed)
+ * - 0x0c: entry count
+ * - 0x10: entries, each 0x50 + name size (see metaindex_write_entry)
+ */
+
+#define METAINDEX_ID            0x494D4756 /* "VGMI" LE */
+#define METAINDEX_VERSION       1
+#define METAINDEX_HEADER_SIZE   0x10
+#define METAINDEX_ENTRY_SIZE    0x50
+#define METAINDEX_HASH_SIZE     0x100 /* bytes hashed at the start and end of the file */
+
+struct vgmstream_index_t {
+    int format_count;
+    metaindex_entry_t* entries;
+    int count;
+    int capacity;
+    int sorted;             /* by hash, for binary search */
+};
+
+static vgmstream_index_t* active_index = NULL;
+
+
+static uint64_t metaindex_hash_data(uint64_t hash, const uint8_t* data, size_t size) {
+    /* FNV-1a */
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/* gets the name without path and the hash identifying the file, returns 0 if it can't be indexed */
+static int metaindex_identify(STREAMFILE* sf, char* name, uint64_t* p_hash, uint64_t* p_file_size) {
+    char filename[PATH_LIMIT];
+    uint8_t buf[METAINDEX_HASH_SIZE];
+    const char* basename;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t file_size, bytes;
+
+    get_streamfile_name(sf, filename, sizeof(filename));
+    basename = filename;
+    for (const char* c = filename; *c != '\0'; c++) {
+        if (*c == '/' || *c == '\\')
+            basename = c + 1;
+    }
+
+    if (strlen(basename) >= METAINDEX_NAME_SIZE)
+        return 0;
+    strcpy(name, basename);
+
+    file_size = get_streamfile_size(sf);
+    put_u32le(buf + 0x00, (uint32_t)file_size);
+    put_u32le(buf + 0x04, (uint32_t)((uint64_t)file_size >> 32));
+    hash = metaindex_hash_data(hash, buf, 0x08);
+    hash = metaindex_hash_data(hash, (const uint8_t*)name, strlen(name));
+
+    /* first and last bytes, plenty to tell apart changed files of the same size (and already pinned by the probe) */
+    bytes = read_streamfile(buf, 0, file_size < sizeof(buf) ? file_size : sizeof(buf), sf);
+    hash = metaindex_hash_data(hash, buf, bytes);
+    if (file_size > sizeof(buf)) {
+        size_t tail_size = file_size - sizeof(buf) < sizeof(buf) ? file_size - sizeof(buf) : sizeof(buf);
+        bytes = read_streamfile(buf, file_size - tail_size, tail_size, sf);
+        hash = metaindex_hash_data(hash, buf, bytes);
+    }
+
+    *p_hash = hash;
+    *p_file_size = file_size;
+    return 1;
+}
+
+/* resolved key in the format metas read with read_probe_streamfile_key, returns its size (0 if none) */
+static int metaindex_get_key(VGMSTREAM* vgmstream, uint8_t* key) {
+    switch (vgmstream->coding_type) {
+        case coding_CRI_ADX_enc_8:
+        case coding_CRI_ADX_enc_9: /* xor start/mult/add as set on init */
+            put_u16be(key + 0x00, vgmstream->start_ch[0].adx_xor);
+            put_u16be(key + 0x02, vgmstream->start_ch[0].adx_mult);
+            put_u16be(key + 0x04, vgmstream->start_ch[0].adx_add);
+            return 0x06;
+
+        case coding_CRI_HCA: { /* keycode + subkey */
+            uint64_t keycode, subkey;
+            if (!hca_get_encryption_key(vgmstream->codec_data, &keycode, &subkey))
+                return 0;
+            put_u32be(key + 0x00, (uint32_t)(keycode >> 32));
+            put_u32be(key + 0x04, (uint32_t)(keycode >> 0));
+            put_u16be(key + 0x08, (uint16_t)subkey);
+            return 0x08 + 0x02;
+        }
+
+        default:
+            return 0;
+    }
+}
+
+static int metaindex_compare(const void* a, const void* b) {
+    uint64_t hash_a = ((const metaindex_entry_t*)a)->hash;
+    uint64_t hash_b = ((const metaindex_entry_t*)b)->hash;
+    return hash_a < hash_b ? -1 : (hash_a > hash_b ? 1 : 0);
+}
+
+static void metaindex_sort(vgmstream_index_t* index) {
+    if (index->sorted)
+        return;
+    qsort(index->entries, index->count, sizeof(metaindex_entry_t), metaindex_compare);
+    index->sorted = 1;
+}
+
+/* (clears entries made for another init function table) */
+static metaindex_entry_t* metaindex_new_entry(vgmstream_index_t* index, int format_count) {
+    if (index->format_count != format_count) {
+        index->format_count = format_count;
+        index->count = 0;
+    }
+
+    if (index->count == index->capacity) {
+        int capacity = index->capacity ? index->capacity * 2 : 256;
+        metaindex_entry_t* entries = realloc(index->entries, capacity * sizeof(metaindex_entry_t));
+        if (!entries) return NULL;
+
+        index->entries = entries;
+        index->capacity = capacity;
+    }
+
+    index->sorted = 0;
+    return &index->entries[index->count++];
+}
+
+
+const metaindex_entry_t* metaindex_find(vgmstream_index_t* index, STREAMFILE* sf, int format_count) {
+    char name[METAINDEX_NAME_SIZE];
+    uint64_t hash, file_size;
+
+    if (!index || index->format_count != format_count || index->count == 0 || sf->stream_index > 0)
+        return NULL;
+    if (!metaindex_identify(sf, name, &hash, &file_size))
+        return NULL;
+
+    if (index->sorted) {
+        int lo = 0, hi = index->count;
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            if (index->entries[mid].hash < hash)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        for (int i = lo; i < index->count && index->entries[i].hash == hash; i++) {
+            const metaindex_entry_t* entry = &index->entries[i];
+            if (entry->file_size == file_size && strcmp(entry->name, name) == 0)
+                return entry;
+        }
+    }
+    else {
+        for (int i = 0; i < index->count; i++) {
+            const metaindex_entry_t* entry = &index->entries[i];
+            if (entry->hash == hash && entry->file_size == file_size && strcmp(entry->name, name) == 0)
+                return entry;
+        }
+    }
+
+    return NULL;
+}
+
+int metaindex_add(vgmstream_index_t* index, STREAMFILE* sf, int format, VGMSTREAM* vgmstream, int format_count) {
+    metaindex_entry_t entry = {0};
+
+    if (!metaindex_identify(sf, entry.name, &entry.hash, &entry.file_size))
+        return 0;
+
+    entry.format = format;
+    entry.meta_type = vgmstream->meta_type;
+    entry.coding_type = vgmstream->coding_type;
+    entry.sample_rate = vgmstream->sample_rate;
+    entry.channels = vgmstream->channels;
+    entry.num_samples = vgmstream->num_samples;
+    entry.loop_flag = vgmstream->loop_flag;
+    entry.loop_start_sample = vgmstream->loop_start_sample;
+    entry.loop_end_sample = vgmstream->loop_end_sample;
+    entry.num_streams = vgmstream->num_streams;
+    entry.start_offset = (uint32_t)vgmstream->start_ch[0].channel_start_offset;
+    entry.key_size = metaindex_get_key(vgmstream, entry.key);
+
+    return metaindex_add_entry(index, &entry, format_count);
+}
+
+int metaindex_add_entry(vgmstream_index_t* index, const metaindex_entry_t* entry, int format_count) {
+    metaindex_entry_t* new_entry = metaindex_new_entry(index, format_count);
+    if (!new_entry) return 0;
+
+    *new_entry = *entry;
+    return 1;
+}
+
+int metaindex_check(const metaindex_entry_t* entry, VGMSTREAM* vgmstream) {
+    return entry->meta_type == vgmstream->meta_type
+        && entry->coding_type == vgmstream->coding_type
+        && entry->sample_rate == vgmstream->sample_rate
+        && entry->channels == vgmstream->channels
+        && entry->num_samples == vgmstream->num_samples
+        && entry->loop_flag == vgmstream->loop_flag
+        && entry->loop_start_sample == vgmstream->loop_start_sample
+        && entry->loop_end_sample == vgmstream->loop_end_sample
+        && entry->num_streams == vgmstream->num_streams
+        && entry->start_offset == (uint32_t)vgmstream->start_ch[0].channel_start_offset;
+}
+
+vgmstream_index_t* metaindex_get_active(void) {
+    return active_index;
+}
+
+
+/*****************************************************************************/
+
+vgmstream_index_t* vgmstream_index_init(void) {
+    return calloc(1, sizeof(vgmstream_index_t));
+}
+
+vgmstream_index_t* vgmstream_index_load(STREAMFILE* sf) {
+    vgmstream_index_t* index = NULL;
+    uint8_t* buf = NULL;
+    size_t file_size, offset;
+    int count;
+
+    if (!sf) return NULL;
+
+    file_size = get_streamfile_size(sf);
+    if (file_size < METAINDEX_HEADER_SIZE)
+        goto fail;
+
+    buf = malloc(file_size);
+    if (!buf) goto fail;
+    if (read_streamfile(buf, 0, file_size, sf) != file_size)
+        goto fail;
+
+    if (get_u32le(buf + 0x00) != METAINDEX_ID || get_u32le(buf + 0x04) != METAINDEX_VERSION)
+        goto fail;
+
+    index = vgmstream_index_init();
+    if (!index) goto fail;
+
+    index->format_count = get_s32le(buf + 0x08);
+    count = get_s32le(buf + 0x0c);
+
+    offset = METAINDEX_HEADER_SIZE;
+    for (int i = 0; i < count; i++) {
+        metaindex_entry_t* entry;
+        const uint8_t* data = buf + offset;
+        size_t name_size;
+
+        if (offset + METAINDEX_ENTRY_SIZE > file_size)
+            goto fail;
+        name_size = get_u16le(data + 0x3e);
+        if (name_size >= METAINDEX_NAME_SIZE || offset + METAINDEX_ENTRY_SIZE + name_size > file_size)
+            goto fail;
+
+        entry = metaindex_new_entry(index, index->format_count);
+        if (!entry) goto fail;
+
+        entry->hash             = get_u64le(data + 0x00);
+        entry->file_size        = get_u64le(data + 0x08);
+        entry->format           = get_s32le(data + 0x10);
+        entry->meta_type        = get_s32le(data + 0x14);
+        entry->coding_type      = get_s32le(data + 0x18);
+        entry->sample_rate      = get_s32le(data + 0x1c);
+        entry->channels         = get_s32le(data + 0x20);
+        entry->num_samples      = get_s32le(data + 0x24);
+        entry->loop_start_sample = get_s32le(data + 0x28);
+        entry->loop_end_sample  = get_s32le(data + 0x2c);
+        entry->num_streams      = get_s32le(data + 0x30);
+        entry->start_offset     = get_u32le(data + 0x34);
+        /* 0x38: reserved */
+        entry->loop_flag        = get_u8(data + 0x3c);
+        entry->key_size         = get_u8(data + 0x3d);
+        memcpy(entry->key, data + 0x40, sizeof(entry->key));
+        memcpy(entry->name, data + METAINDEX_ENTRY_SIZE, name_size);
+        entry->name[name_size] = '\0';
+
+        if (entry->format < 0 || entry->format >= index->format_count || entry->key_size > (int)sizeof(entry->key))
+            goto fail;
+
+        offset += METAINDEX_ENTRY_SIZE + name_size;
+    }
+
+    metaindex_sort(index);
+    free(buf);
+    return index;
+fail:
+    vgmstream_index_close(index);
+    free(buf);
+    return NULL;
+}
+
+static void metaindex_write_entry(uint8_t* data, const metaindex_entry_t* entry) {
+    size_t name_size = strlen(entry->name);
+
+    put_u32le(data + 0x00, (uint32_t)(entry->hash >> 0));
+    put_u32le(data + 0x04, (uint32_t)(entry->hash >> 32));
+    put_u32le(data + 0x08, (uint32_t)(entry->file_size >> 0));
+    put_u32le(data + 0x0c, (uint32_t)(entry->file_size >> 32));
+    put_s32le(data + 0x10, entry->format);
+    put_s32le(data + 0x14, entry->meta_type);
+    put_s32le(data + 0x18, entry->coding_type);
+    put_s32le(data + 0x1c, entry->sample_rate);
+    put_s32le(data + 0x20, entry->channels);
+    put_s32le(data + 0x24, entry->num_samples);
+    put_s32le(data + 0x28, entry->loop_start_sample);
+    put_s32le(data + 0x2c, entry->loop_end_sample);
+    put_s32le(data + 0x30, entry->num_streams);
+    put_u32le(data + 0x34, entry->start_offset);
+    put_u32le(data + 0x38, 0);
+    put_u8   (data + 0x3c, entry->loop_flag);
+    put_u8   (data + 0x3d, entry->key_size);
+    put_u16le(data + 0x3e, name_size);
+    memcpy(data + 0x40, entry->key, sizeof(entry->key));
+    memcpy(data + METAINDEX_ENTRY_SIZE, entry->name, name_size);
+}
+
+size_t vgmstream_index_write(vgmstream_index_t* index, uint8_t* buf, size_t buf_size) {
+    size_t size = METAINDEX_HEADER_SIZE;
+    size_t offset;
+
+    if (!index) return 0;
+
+    for (int i = 0; i < index->count; i++) {
+        size += METAINDEX_ENTRY_SIZE + strlen(index->entries[i].name);
+    }
+
+    if (!buf || buf_size < size)
+        return size;
+
+    /* sorted, so output doesn't depend on the order files were added */
+    metaindex_sort(index);
+
+    put_u32le(buf + 0x00, METAINDEX_ID);
+    put_u32le(buf + 0x04, METAINDEX_VERSION);
+    put_s32le(buf + 0x08, index->format_count);
+    put_s32le(buf + 0x0c, index->count);
+
+    offset = METAINDEX_HEADER_SIZE;
+    for (int i = 0; i < index->count; i++) {
+        metaindex_write_entry(buf + offset, &index->entries[i]);
+        offset += METAINDEX_ENTRY_SIZE + strlen(index->entries[i].name);
+    }
+
+    return size;
+}
+
+void vgmstream_index_set(vgmstream_index_t* index) {
+    if (index)
+        metaindex_sort(index);
+    active_index = index;
+}
+
+void vgmstream_index_close(vgmstream_index_t* index) {
+    if (!index) return;
+
+    if (active_index == index)
+        active_index = NULL;
+    free(index->entries);
+    free(index);
+}
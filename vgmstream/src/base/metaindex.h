@@ -0,0 +1,42 @@
+#ifndef _METAINDEX_H
+#define _METAINDEX_H
+
+#include "../vgmstream.h"
+
+#define METAINDEX_NAME_SIZE 0x100  /* longer names aren't indexed */
+
+/* Remembered detection result of a file. Besides skipping detection, fields are compared to what the format returns
+ * when opened again, so an outdated entry (different file with same name/size/hash, changed vgmstream) is ignored. */
+typedef struct {
+    uint64_t hash;          /* of name, size, first and last bytes */
+    uint64_t file_size;
+    int format;             /* position in the init function table */
+    int meta_type;
+    int coding_type;
+    int sample_rate;
+    int channels;
+    int32_t num_samples;
+    int loop_flag;
+    int32_t loop_start_sample;
+    int32_t loop_end_sample;
+    int num_streams;
+    uint32_t start_offset;
+    uint8_t key[0x10];      /* resolved decryption key in a per-codec format, see metaindex_get_key */
+    int key_size;
+    char name[METAINDEX_NAME_SIZE]; /* without path */
+} metaindex_entry_t;
+
+/* Finds the entry of sf (the default subsong only), or NULL if the index was made for a different table. */
+const metaindex_entry_t* metaindex_find(vgmstream_index_t* index, STREAMFILE* sf, int format_count);
+
+/* Adds the detection result of sf, or copies an entry found in another index. Returns 0 on error. */
+int metaindex_add(vgmstream_index_t* index, STREAMFILE* sf, int format, VGMSTREAM* vgmstream, int format_count);
+int metaindex_add_entry(vgmstream_index_t* index, const metaindex_entry_t* entry, int format_count);
+
+/* Checks the format opened from an entry returned the same stream. */
+int metaindex_check(const metaindex_entry_t* entry, VGMSTREAM* vgmstream);
+
+/* Index used by init_vgmstream, if set. */
+vgmstream_index_t* metaindex_get_active(void);
+
+#endif
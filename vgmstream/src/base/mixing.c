@@ -68,7 +68,22 @@ static void sbuf_copy_f32_to_s16(int16_t* buf_s16, float* buf_f32, int samples,
     }
 }
 
-void mix_vgmstream(sample_t *outbuf, int32_t sample_count, VGMSTREAM* vgmstream) {
+static void sbuf_copy_mixbuf_to_f32(float* buf_out, float* buf_f32, int samples, int channels) {
+    const float scale = 1.0f / 32768.0f;
+    for (int s = 0; s < samples * channels; s++) {
+        buf_out[s] = buf_f32[s] * scale;
+    }
+}
+
+static void sbuf_copy_s16_to_f32(float* buf_f32, int16_t* buf_s16, int samples, int channels) {
+    const float scale = 1.0f / 32768.0f;
+    for (int s = 0; s < samples * channels; s++) {
+        buf_f32[s] = buf_s16[s] * scale;
+    }
+}
+
+/* applies mixes from outbuf into mixbuf, returns 0 if nothing needed to be done (mixbuf is unset) */
+static int mix_apply(sample_t *outbuf, int32_t sample_count, VGMSTREAM* vgmstream) {
     mixing_data *data = vgmstream->mixing_data;
     int ch, s, m, ok;
 
@@ -82,14 +97,14 @@ void mix_vgmstream(sample_t *outbuf, int32_t sample_count, VGMSTREAM* vgmstream)
 
     /* no support or not need to apply */
     if (!data || !data->mixing_on || data->mixing_count == 0)
-        return;
+        return 0;
 
     /* try to skip if no fades apply (set but does nothing yet) + only has fades */
     if (data->has_fade) {
         int32_t current_pos = get_current_pos(vgmstream, sample_count);
         //;VGM_LOG("MIX: fade test %i, %i\n", data->has_non_fade, is_fade_active(data, current_pos, current_pos + sample_count));
         if (!data->has_non_fade && !is_fade_active(data, current_pos, current_pos + sample_count))
-            return;
+            return 0;
         //;VGM_LOG("MIX: fade pos=%i\n", current_pos);
         current_subpos = current_pos;
     }
@@ -215,10 +230,33 @@ void mix_vgmstream(sample_t *outbuf, int32_t sample_count, VGMSTREAM* vgmstream)
         temp_outbuf += vgmstream->channels;
     }
 
+    return 1;
+}
+
+void mix_vgmstream(sample_t *outbuf, int32_t sample_count, VGMSTREAM* vgmstream) {
+    mixing_data *data = vgmstream->mixing_data;
+
+    if (!mix_apply(outbuf, sample_count, vgmstream))
+        return;
+
     /* copy resulting temp mix to output */
     sbuf_copy_f32_to_s16(outbuf, data->mixbuf, sample_count, data->output_channels);
 }
 
+int mix_vgmstream_f32(sample_t *inbuf, float *outbuf, int32_t sample_count, VGMSTREAM* vgmstream) {
+    mixing_data *data = vgmstream->mixing_data;
+
+    /* unmixed samples (or only inactive fades) keep the base channels */
+    if (!mix_apply(inbuf, sample_count, vgmstream)) {
+        sbuf_copy_s16_to_f32(outbuf, inbuf, sample_count, vgmstream->channels);
+        return vgmstream->channels;
+    }
+
+    /* mixbuf is already float so results aren't truncated or clipped */
+    sbuf_copy_mixbuf_to_f32(outbuf, data->mixbuf, sample_count, data->output_channels);
+    return data->output_channels;
+}
+
 /* ******************************************************************* */
 
 void mixing_init(VGMSTREAM* vgmstream) {
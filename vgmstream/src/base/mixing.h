@@ -7,6 +7,10 @@
  * outbuf must big enough to hold output_channels*samples_to_do */
 void mix_vgmstream(sample_t *outbuf, int32_t sample_count, VGMSTREAM* vgmstream);
 
+/* Same but leaves inbuf untouched and writes float samples (-1.0..1.0) to outbuf.
+ * Returns the number of channels in outbuf. */
+int mix_vgmstream_f32(sample_t *inbuf, float *outbuf, int32_t sample_count, VGMSTREAM* vgmstream);
+
 /* internal mixing pre-setup for vgmstream (doesn't imply usage).
  * If init somehow fails next calls are ignored. */
 void mixing_init(VGMSTREAM* vgmstream);
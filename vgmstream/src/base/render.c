@@ -4,6 +4,7 @@
 #include "decode.h"
 #include "mixing.h"
 #include "plugins.h"
+#include "seektable.h"
 
 
 /* VGMSTREAM RENDERING
@@ -348,19 +349,27 @@ static void render_trim(VGMSTREAM* vgmstream) {
     }
 }
 
-static int render_pad_begin(VGMSTREAM* vgmstream, sample_t* buf, int samples_to_do) {
+/* outputs are either pcm16 (buf) or float (buf_f32), helpers take whichever is set */
+static void render_silence(sample_t* buf, float* buf_f32, int offset, int samples, int channels) {
+    if (buf_f32)
+        memset(buf_f32 + offset * channels, 0, samples * sizeof(float) * channels);
+    else
+        memset(buf + offset * channels, 0, samples * sizeof(sample_t) * channels);
+}
+
+static int render_pad_begin(VGMSTREAM* vgmstream, sample_t* buf, float* buf_f32, int samples_to_do) {
     int channels = vgmstream->pstate.output_channels;
     int to_do = vgmstream->pstate.pad_begin_left;
     if (to_do > samples_to_do)
         to_do = samples_to_do;
 
-    memset(buf, 0, to_do * sizeof(sample_t) * channels);
+    render_silence(buf, buf_f32, 0, to_do, channels);
     vgmstream->pstate.pad_begin_left -= to_do;
 
     return to_do;
 }
 
-static int render_fade(VGMSTREAM* vgmstream, sample_t* buf, int samples_left) {
+static int render_fade(VGMSTREAM* vgmstream, sample_t* buf, float* buf_f32, int samples_left) {
     play_state_t* ps = &vgmstream->pstate;
     //play_config_t* pc = &vgmstream->config;
 
@@ -389,6 +398,13 @@ static int render_fade(VGMSTREAM* vgmstream, sample_t* buf, int samples_left) {
         //TODO: use delta fadedness to improve performance?
         for (s = start; s < start + to_do; s++, fade_pos++) {
             double fadedness = (double)(ps->fade_duration - fade_pos) / ps->fade_duration;
+            if (buf_f32) {
+                for (ch = 0; ch < channels; ch++) {
+                    buf_f32[s*channels + ch] = buf_f32[s*channels + ch] * (float)fadedness;
+                }
+                continue;
+            }
+
             for (ch = 0; ch < channels; ch++) {
                 buf[s*channels + ch] = (sample_t)buf[s*channels + ch] * fadedness;
             }
@@ -397,12 +413,12 @@ static int render_fade(VGMSTREAM* vgmstream, sample_t* buf, int samples_left) {
         ps->fade_left -= to_do;
 
         /* next samples after fade end would be pad end/silence, so we can just memset */
-        memset(buf + (start + to_do) * channels, 0, (samples_left - to_do - start) * sizeof(sample_t) * channels);
+        render_silence(buf, buf_f32, start + to_do, samples_left - to_do - start, channels);
         return start + to_do;
     }
 }
 
-static int render_pad_end(VGMSTREAM* vgmstream, sample_t* buf, int samples_left) {
+static int render_pad_end(VGMSTREAM* vgmstream, sample_t* buf, float* buf_f32, int samples_left) {
     play_state_t* ps = &vgmstream->pstate;
     int channels = vgmstream->pstate.output_channels;
     int skip = 0;
@@ -422,25 +438,42 @@ static int render_pad_end(VGMSTREAM* vgmstream, sample_t* buf, int samples_left)
     if (to_do > samples_left - skip)
         to_do = samples_left - skip;
 
-    memset(buf + (skip * channels), 0, to_do * sizeof(sample_t) * channels);
+    render_silence(buf, buf_f32, skip, to_do, channels);
     return skip + to_do;
 }
 
 
+/* Decodes pcm16 into buf, or into tmpbuf and then converts to float into buf_f32 */
+static int render_decode(sample_t* buf, float* buf_f32, int32_t sample_count, VGMSTREAM* vgmstream) {
+    int done;
+
+    if (!buf_f32) {
+        done = render_layout(buf, sample_count, vgmstream);
+        seektable_save(vgmstream);
+        mix_vgmstream(buf, done, vgmstream);
+        return done;
+    }
+
+    done = render_layout(vgmstream->tmpbuf, sample_count, vgmstream);
+    seektable_save(vgmstream);
+    mix_vgmstream_f32(vgmstream->tmpbuf, buf_f32, done, vgmstream);
+    return done;
+}
+
 /* Decode data into sample buffer. Controls the "external" part of the decoding,
  * while layout/decode control the "internal" part. */
-int render_vgmstream(sample_t* buf, int32_t sample_count, VGMSTREAM* vgmstream) {
+static int render_main(sample_t* buf, float* buf_f32, int32_t sample_count, VGMSTREAM* vgmstream) {
     play_state_t* ps = &vgmstream->pstate;
     int samples_to_do = sample_count;
     int samples_done = 0;
     int done;
     sample_t* tmpbuf = buf;
+    float* tmpbuf_f32 = buf_f32;
 
 
     /* simple mode with no settings (just skip everything below) */
     if (!vgmstream->config_enabled) {
-        render_layout(buf, samples_to_do, vgmstream);
-        mix_vgmstream(buf, samples_to_do, vgmstream);
+        render_decode(buf, buf_f32, samples_to_do, vgmstream);
         return samples_to_do;
     }
 
@@ -452,43 +485,41 @@ int render_vgmstream(sample_t* buf, int32_t sample_count, VGMSTREAM* vgmstream)
 
     /* adds empty samples to buf */
     if (ps->pad_begin_left) {
-        done = render_pad_begin(vgmstream, tmpbuf, samples_to_do);
+        done = render_pad_begin(vgmstream, tmpbuf, tmpbuf_f32, samples_to_do);
         samples_done += done;
         samples_to_do -= done;
-        tmpbuf += done * vgmstream->pstate.output_channels; /* as if mixed */
+        if (tmpbuf_f32) tmpbuf_f32 += done * vgmstream->pstate.output_channels;
+        else tmpbuf += done * vgmstream->pstate.output_channels; /* as if mixed */
     }
 
     /* end padding (before to avoid decoding if possible, but must be inside pad region) */
     if (!vgmstream->config.play_forever
             && ps->play_position /*+ samples_to_do*/ >= ps->pad_end_start
             && samples_to_do) {
-        done = render_pad_end(vgmstream, tmpbuf, samples_to_do);
+        done = render_pad_end(vgmstream, tmpbuf, tmpbuf_f32, samples_to_do);
         samples_done += done;
         samples_to_do -= done;
-        tmpbuf += done * vgmstream->pstate.output_channels; /* as if mixed */
+        if (tmpbuf_f32) tmpbuf_f32 += done * vgmstream->pstate.output_channels;
+        else tmpbuf += done * vgmstream->pstate.output_channels; /* as if mixed */
     }
 
     /* main decode */
     { //if (samples_to_do)  /* 0 ok, less likely */
-        done = render_layout(tmpbuf, samples_to_do, vgmstream);
-
-        mix_vgmstream(tmpbuf, done, vgmstream);
+        done = render_decode(tmpbuf, tmpbuf_f32, samples_to_do, vgmstream);
 
         samples_done += done;
 
         if (!vgmstream->config.play_forever) {
             /* simple fadeout */
             if (ps->fade_left && ps->play_position + done >= ps->fade_start) {
-                render_fade(vgmstream, tmpbuf, done);
+                render_fade(vgmstream, tmpbuf, tmpbuf_f32, done);
             }
 
             /* silence leftover buf samples (rarely used when no fade is set) */
             if (ps->play_position + done >= ps->pad_end_start) {
-                render_pad_end(vgmstream, tmpbuf, done);
+                render_pad_end(vgmstream, tmpbuf, tmpbuf_f32, done);
             }
         }
-
-        tmpbuf += done * vgmstream->pstate.output_channels;
     }
 
 
@@ -508,3 +539,34 @@ int render_vgmstream(sample_t* buf, int32_t sample_count, VGMSTREAM* vgmstream)
 
     return samples_done;
 }
+
+int render_vgmstream(sample_t* buf, int32_t sample_count, VGMSTREAM* vgmstream) {
+    return render_main(buf, NULL, sample_count, vgmstream);
+}
+
+/* Float output still decodes pcm16, but in tmpbuf-sized steps so that mixing and fades
+ * can write float directly instead of truncating back to pcm16. */
+int render_vgmstream_f32(float* buf, int32_t sample_count, VGMSTREAM* vgmstream) {
+    int input_channels, output_channels;
+    int32_t max_samples;
+    int samples_done = 0;
+
+    mixing_info(vgmstream, &input_channels, &output_channels);
+    max_samples = vgmstream->tmpbuf_size / input_channels;
+
+    while (samples_done < sample_count) {
+        int to_do = sample_count - samples_done;
+        int done;
+        if (to_do > max_samples)
+            to_do = max_samples;
+
+        done = render_main(NULL, buf + samples_done * output_channels, to_do, vgmstream);
+        samples_done += done;
+
+        /* stream end */
+        if (done < to_do)
+            break;
+    }
+
+    return samples_done;
+}
@@ -4,6 +4,7 @@
 #include "decode.h"
 #include "mixing.h"
 #include "plugins.h"
+#include "seektable.h"
 
 /* pretend decoder reached loop end so internal state is set like jumping to loop start 
  * (no effect in some layouts but that is ok) */
@@ -17,7 +18,7 @@ static void seek_force_loop_end(VGMSTREAM* vgmstream, int loop_count) {
     decode_do_loop(vgmstream);
 }
 
-static void seek_force_decode(VGMSTREAM* vgmstream, int samples) {
+static void seek_force_render(VGMSTREAM* vgmstream, int samples) {
     sample_t* tmpbuf = vgmstream->tmpbuf;
     size_t tmpbuf_size = vgmstream->tmpbuf_size;
     int32_t buf_samples = tmpbuf_size / vgmstream->channels; /* base channels, no need to apply mixing */
@@ -28,11 +29,52 @@ static void seek_force_decode(VGMSTREAM* vgmstream, int samples) {
             to_do = buf_samples;
 
         render_layout(tmpbuf, to_do, vgmstream);
+        seektable_save(vgmstream);
         /* no mixing */
         samples -= to_do;
     }
 }
 
+/* decodes and discards samples, starting from saved points closer to the target when possible */
+static void seek_force_decode(VGMSTREAM* vgmstream, int samples) {
+
+    if (!vgmstream->seek_data || (vgmstream->loop_flag && vgmstream->current_sample > vgmstream->loop_end_sample)) {
+        seek_force_render(vgmstream, samples);
+        return;
+    }
+
+    /* points can't be used across loop end, so go pass by pass */
+    while (samples > 0) {
+        int32_t start, target;
+
+        /* same as layouts would do before decoding next sample */
+        if (vgmstream->loop_flag && vgmstream->current_sample == vgmstream->loop_end_sample)
+            decode_do_loop(vgmstream);
+
+        start = vgmstream->current_sample;
+        target = start + samples;
+        if (vgmstream->loop_flag && target > vgmstream->loop_end_sample)
+            target = vgmstream->loop_end_sample;
+        if (target <= start) { /* bad loop points */
+            seek_force_render(vgmstream, samples);
+            break;
+        }
+
+        /* points past loop start can only be used once loop state is set, which happens when decoding reaches it */
+        if (vgmstream->loop_flag && !vgmstream->hit_loop
+                && vgmstream->current_sample <= vgmstream->loop_start_sample && target > vgmstream->loop_start_sample) {
+            seektable_restore(vgmstream, vgmstream->loop_start_sample);
+            seek_force_render(vgmstream, vgmstream->loop_start_sample - vgmstream->current_sample);
+            decode_do_loop(vgmstream);
+        }
+
+        seektable_restore(vgmstream, target);
+        seek_force_render(vgmstream, target - vgmstream->current_sample);
+
+        samples -= target - start;
+    }
+}
+
 
 static void seek_body(VGMSTREAM* vgmstream, int32_t seek_sample) {
     //;VGM_LOG("SEEK: body / seekr=%i, curr=%i\n", seek_sample, vgmstream->current_sample);
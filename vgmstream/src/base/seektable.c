@@ -0,0 +1,320 @@
+#include "../vgmstream.h"
+#include "seektable.h"
+
+/* SEEK TABLE
+ * Seeking normally decodes and discards from the start (or loop start) up to the seek sample, which gets slow
+ * with long files. For simple codecs the whole decoder state is a few values per channel (offset, ADPCM history,
+ * ADX key state), so it's saved every SEEKTABLE_INTERVAL samples while decoding, and a seek can restore the
+ * closest point before the target and decode only the rest.
+ *
+ * Points are saved lazily during playback (and seeks), so seeking only gets faster in parts already decoded.
+ *
+ * After the loop start, state depends on loop_ch: some formats copy ADPCM history into it when looping
+ * (see decode_do_loop), so each pass may decode the loop region differently. Those points are tagged with
+ * the loop state they were decoded from, and only restored when loop_ch is the same.
+ */
+
+#define SEEKTABLE_MAX_LOOPS 8
+
+typedef struct {
+    off_t offset;
+    off_t frame_header_offset;
+    int samples_left_in_frame;
+    int32_t adpcm_history1_32;
+    int32_t adpcm_history2_32;
+    int32_t adpcm_history3_32;
+    int32_t adpcm_history4_32;
+    int adpcm_step_index;
+    int adpcm_scale;
+    uint16_t adx_xor;
+} seektable_channel_t;
+
+typedef struct {
+    int32_t current_sample;
+    int32_t samples_into_block;
+    int loop;                       /* index in loops, or -1 if saved before hitting loop start */
+} seektable_point_t;
+
+typedef struct {
+    int32_t loop_current_sample;
+    int32_t loop_samples_into_block;
+} seektable_loop_t;
+
+typedef struct {
+    int channels;
+    int count;
+    int capacity;
+    seektable_point_t* points;      /* sorted by sample */
+    seektable_channel_t* chs;       /* channels * capacity */
+
+    int loop_count;
+    seektable_loop_t loops[SEEKTABLE_MAX_LOOPS];
+    seektable_channel_t* loop_chs;  /* channels * SEEKTABLE_MAX_LOOPS */
+} seektable_t;
+
+
+/* codecs whose state is fully in the fields above, and layouts that only depend on current_sample/samples_into_block */
+static int is_supported(VGMSTREAM* vgmstream) {
+    if (vgmstream->codec_data || vgmstream->layout_data)
+        return 0;
+
+    switch(vgmstream->layout_type) {
+        case layout_none:
+        case layout_interleave:
+            break;
+        default:
+            return 0;
+    }
+
+    switch(vgmstream->coding_type) {
+        case coding_PCM16LE:
+        case coding_PCM16BE:
+        case coding_PCM16_int:
+        case coding_PCM8:
+        case coding_PCM8_int:
+        case coding_PCM8_U:
+        case coding_CRI_ADX:
+        case coding_CRI_ADX_fixed:
+        case coding_CRI_ADX_exp:
+        case coding_CRI_ADX_enc_8:
+        case coding_CRI_ADX_enc_9:
+        case coding_NGC_DSP:
+        case coding_NGC_DSP_subint:
+        case coding_PSX:
+        case coding_PSX_badflags:
+        case coding_PSX_cfg:
+        case coding_HEVAG:
+        case coding_IMA:
+        case coding_IMA_int:
+        case coding_DVI_IMA:
+        case coding_DVI_IMA_int:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/* last sample that can be reached without looping */
+static int32_t get_end_sample(VGMSTREAM* vgmstream) {
+    return vgmstream->loop_flag ? vgmstream->loop_end_sample : vgmstream->num_samples;
+}
+
+static void get_channel(seektable_channel_t* sch, VGMSTREAMCHANNEL* ch) {
+    memset(sch, 0, sizeof(seektable_channel_t)); /* padding too, as loop states are compared */
+    sch->offset = ch->offset;
+    sch->frame_header_offset = ch->frame_header_offset;
+    sch->samples_left_in_frame = ch->samples_left_in_frame;
+    sch->adpcm_history1_32 = ch->adpcm_history1_32;
+    sch->adpcm_history2_32 = ch->adpcm_history2_32;
+    sch->adpcm_history3_32 = ch->adpcm_history3_32;
+    sch->adpcm_history4_32 = ch->adpcm_history4_32;
+    sch->adpcm_step_index = ch->adpcm_step_index;
+    sch->adpcm_scale = ch->adpcm_scale;
+    sch->adx_xor = ch->adx_xor;
+}
+
+static void set_channel(VGMSTREAMCHANNEL* ch, seektable_channel_t* sch) {
+    ch->offset = sch->offset;
+    ch->frame_header_offset = sch->frame_header_offset;
+    ch->samples_left_in_frame = sch->samples_left_in_frame;
+    ch->adpcm_history1_32 = sch->adpcm_history1_32;
+    ch->adpcm_history2_32 = sch->adpcm_history2_32;
+    ch->adpcm_history3_32 = sch->adpcm_history3_32;
+    ch->adpcm_history4_32 = sch->adpcm_history4_32;
+    ch->adpcm_step_index = sch->adpcm_step_index;
+    ch->adpcm_scale = sch->adpcm_scale;
+    ch->adx_xor = sch->adx_xor;
+}
+
+/* index of current loop state, added if new and add is set, or -1 (also when loop start wasn't hit) */
+static int find_loop(seektable_t* table, VGMSTREAM* vgmstream, int add) {
+    seektable_channel_t sch;
+    int i, ch;
+
+    if (!vgmstream->hit_loop)
+        return -1;
+
+    for (i = 0; i < table->loop_count; i++) {
+        if (table->loops[i].loop_current_sample != vgmstream->loop_current_sample ||
+                table->loops[i].loop_samples_into_block != vgmstream->loop_samples_into_block)
+            continue;
+
+        for (ch = 0; ch < table->channels; ch++) {
+            get_channel(&sch, &vgmstream->loop_ch[ch]);
+            if (memcmp(&sch, &table->loop_chs[i * table->channels + ch], sizeof(seektable_channel_t)) != 0)
+                break;
+        }
+        if (ch == table->channels)
+            return i;
+    }
+
+    if (!add || table->loop_count >= SEEKTABLE_MAX_LOOPS)
+        return -1;
+
+    i = table->loop_count;
+    table->loops[i].loop_current_sample = vgmstream->loop_current_sample;
+    table->loops[i].loop_samples_into_block = vgmstream->loop_samples_into_block;
+    for (ch = 0; ch < table->channels; ch++) {
+        get_channel(&table->loop_chs[i * table->channels + ch], &vgmstream->loop_ch[ch]);
+    }
+    table->loop_count++;
+    return i;
+}
+
+/* index of the last point at or before sample, or -1 */
+static int find_point(seektable_t* table, int32_t sample) {
+    int lo = 0, hi = table->count;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (table->points[mid].current_sample <= sample)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo - 1;
+}
+
+/* points of the same loop state closer than the interval */
+static int has_near_point(seektable_t* table, int pos, int32_t sample, int loop) {
+    int i;
+
+    for (i = pos; i >= 0 && sample - table->points[i].current_sample < SEEKTABLE_INTERVAL; i--) {
+        if (table->points[i].loop == loop)
+            return 1;
+    }
+    for (i = pos + 1; i < table->count && table->points[i].current_sample - sample < SEEKTABLE_INTERVAL; i++) {
+        if (table->points[i].loop == loop)
+            return 1;
+    }
+
+    return 0;
+}
+
+static seektable_t* init_seektable(VGMSTREAM* vgmstream) {
+    seektable_t* table;
+
+    if (!is_supported(vgmstream))
+        return NULL;
+
+    table = calloc(1, sizeof(seektable_t));
+    if (!table) goto fail;
+
+    table->channels = vgmstream->channels;
+
+    table->loop_chs = calloc(SEEKTABLE_MAX_LOOPS * table->channels, sizeof(seektable_channel_t));
+    if (!table->loop_chs) goto fail;
+
+    return table;
+fail:
+    free(table);
+    return NULL;
+}
+
+static int grow_seektable(seektable_t* table) {
+    int capacity = table->capacity ? table->capacity * 2 : 0x40;
+    seektable_point_t* points;
+    seektable_channel_t* chs;
+
+    points = realloc(table->points, capacity * sizeof(seektable_point_t));
+    if (!points) return 0;
+    table->points = points;
+
+    chs = realloc(table->chs, capacity * table->channels * sizeof(seektable_channel_t));
+    if (!chs) return 0;
+    table->chs = chs;
+
+    table->capacity = capacity;
+    return 1;
+}
+
+
+void seektable_save(VGMSTREAM* vgmstream) {
+    seektable_t* table = vgmstream->seek_data;
+    int32_t sample = vgmstream->current_sample;
+    int i, pos, loop;
+
+    if (sample < SEEKTABLE_INTERVAL || sample >= get_end_sample(vgmstream) || sample > vgmstream->num_samples)
+        return;
+
+    if (!table) {
+        table = init_seektable(vgmstream);
+        if (!table) return;
+        vgmstream->seek_data = table;
+    }
+
+    /* points go between existing ones when decoding resumes from an earlier point */
+    pos = find_point(table, sample);
+    loop = find_loop(table, vgmstream, 0);
+    if (vgmstream->hit_loop && loop < 0) {
+        /* new loop state, no points yet */
+        loop = find_loop(table, vgmstream, 1);
+        if (loop < 0) return;
+    }
+    else if (has_near_point(table, pos, sample, loop)) {
+        return;
+    }
+    pos++;
+
+    if (table->count == table->capacity && !grow_seektable(table))
+        return;
+
+    if (pos < table->count) {
+        memmove(&table->points[pos + 1], &table->points[pos], (table->count - pos) * sizeof(seektable_point_t));
+        memmove(&table->chs[(pos + 1) * table->channels], &table->chs[pos * table->channels],
+                (table->count - pos) * table->channels * sizeof(seektable_channel_t));
+    }
+
+    table->points[pos].current_sample = sample;
+    table->points[pos].samples_into_block = vgmstream->samples_into_block;
+    table->points[pos].loop = loop;
+    for (i = 0; i < table->channels; i++) {
+        get_channel(&table->chs[pos * table->channels + i], &vgmstream->ch[i]);
+    }
+    table->count++;
+}
+
+void seektable_restore(VGMSTREAM* vgmstream, int32_t target) {
+    seektable_t* table = vgmstream->seek_data;
+    int i, pos, loop;
+
+    if (!table || target <= vgmstream->current_sample || target > get_end_sample(vgmstream))
+        return;
+
+    loop = find_loop(table, vgmstream, 0);
+    if (vgmstream->hit_loop && loop < 0)
+        return;
+
+    pos = find_point(table, target);
+    while (pos >= 0 && table->points[pos].current_sample > vgmstream->current_sample) {
+        int32_t sample = table->points[pos].current_sample;
+
+        /* skipping loop start would leave loop_ch unset */
+        int skips_loop = vgmstream->loop_flag && !vgmstream->hit_loop && sample > vgmstream->loop_start_sample;
+
+        if (table->points[pos].loop == loop && !skips_loop)
+            break;
+        pos--;
+    }
+    if (pos < 0 || table->points[pos].current_sample <= vgmstream->current_sample)
+        return;
+
+    vgmstream->current_sample = table->points[pos].current_sample;
+    vgmstream->samples_into_block = table->points[pos].samples_into_block;
+    for (i = 0; i < table->channels; i++) {
+        set_channel(&vgmstream->ch[i], &table->chs[pos * table->channels + i]);
+    }
+}
+
+void seektable_free(VGMSTREAM* vgmstream) {
+    seektable_t* table = vgmstream->seek_data;
+
+    if (!table) return;
+
+    free(table->points);
+    free(table->chs);
+    free(table->loop_chs);
+    free(table);
+    vgmstream->seek_data = NULL;
+}
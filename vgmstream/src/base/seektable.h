@@ -0,0 +1,19 @@
+#ifndef _SEEKTABLE_H
+#define _SEEKTABLE_H
+
+#include "../vgmstream.h"
+
+/* Samples between saved points (max samples decoded after jumping to one, plus the render call size). */
+#define SEEKTABLE_INTERVAL 0x8000
+
+/* Saves decoder state at the current sample if there isn't a point near it (first call sets up the table,
+ * if the codec and layout allow it). Called after decoding. */
+void seektable_save(VGMSTREAM* vgmstream);
+
+/* Jumps to the closest saved point after the current sample and not past target, if any.
+ * Target must be reachable without looping. Points past loop start need hit_loop to be set. */
+void seektable_restore(VGMSTREAM* vgmstream, int32_t target);
+
+void seektable_free(VGMSTREAM* vgmstream);
+
+#endif
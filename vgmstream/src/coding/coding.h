@@ -339,6 +339,8 @@ void reset_hca(hca_codec_data* data);
 void loop_hca(hca_codec_data* data, int32_t num_sample);
 void free_hca(hca_codec_data* data);
 clHCA_stInfo* hca_get_info(hca_codec_data* data);
+/* header info only, without a decoder (for metadata-only probes) */
+int read_hca_info(STREAMFILE* sf, clHCA_stInfo* info);
 
 typedef struct {
     /* config + output */
@@ -352,6 +354,8 @@ typedef struct {
 
 void test_hca_key(hca_codec_data* data, hca_keytest_t* hk);
 void hca_set_encryption_key(hca_codec_data* data, uint64_t keycode, uint64_t subkey);
+/* key set last, returns 0 if the stream isn't encrypted */
+int hca_get_encryption_key(hca_codec_data* data, uint64_t* p_keycode, uint64_t* p_subkey);
 
 STREAMFILE* hca_get_streamfile(hca_codec_data* data);
 
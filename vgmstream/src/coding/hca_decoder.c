@@ -16,23 +16,43 @@ struct hca_codec_data {
     unsigned int current_block;
 
     void* handle;
+
+    uint64_t keycode;   /* as last set (before applying subkey) */
+    uint64_t subkey;
 };
 
-/* init a HCA stream; STREAMFILE will be duplicated for internal use. */
-hca_codec_data* init_hca(STREAMFILE* sf) {
+/* parses the header into a cleared library handle and extracts its info, returns 0 if not valid */
+static int decode_hca_header(void* handle, STREAMFILE* sf, clHCA_stInfo* info) {
     uint8_t header_buffer[0x2000]; /* hca header buffer data (probable max ~0x400) */
-    hca_codec_data* data = NULL; /* vgmstream HCA context */
     int header_size;
     int status;
 
     /* test header */
     if (read_streamfile(header_buffer, 0x00, 0x08, sf) != 0x08)
-        goto fail;
+        return 0;
     header_size = clHCA_isOurFile(header_buffer, 0x08);
     if (header_size < 0 || header_size > 0x1000)
-        goto fail;
+        return 0;
     if (read_streamfile(header_buffer, 0x00, header_size, sf) != header_size)
-        goto fail;
+        return 0;
+
+    clHCA_clear(handle);
+
+    status = clHCA_DecodeHeader(handle, header_buffer, header_size); /* parse header */
+    if (status < 0) {
+        VGM_LOG("HCA: unsupported header found, %i\n", status);
+        return 0;
+    }
+
+    status = clHCA_getInfo(handle, info); /* extract header info */
+    if (status < 0)
+        return 0;
+    return 1;
+}
+
+/* init a HCA stream; STREAMFILE will be duplicated for internal use. */
+hca_codec_data* init_hca(STREAMFILE* sf) {
+    hca_codec_data* data = NULL; /* vgmstream HCA context */
 
     /* init vgmstream context */
     data = calloc(1, sizeof(hca_codec_data));
@@ -40,16 +60,10 @@ hca_codec_data* init_hca(STREAMFILE* sf) {
 
     /* init library handle */
     data->handle = calloc(1, clHCA_sizeof());
-    clHCA_clear(data->handle);
+    if (!data->handle) goto fail;
 
-    status = clHCA_DecodeHeader(data->handle, header_buffer, header_size); /* parse header */
-    if (status < 0) {
-        VGM_LOG("HCA: unsupported header found, %i\n", status);
+    if (!decode_hca_header(data->handle, sf, &data->info))
         goto fail;
-    }
-
-    status = clHCA_getInfo(data->handle, &data->info); /* extract header info */
-    if (status < 0) goto fail;
 
     data->data_buffer = malloc(data->info.blockSize);
     if (!data->data_buffer) goto fail;
@@ -179,6 +193,20 @@ void free_hca(hca_codec_data* data) {
     free(data);
 }
 
+int read_hca_info(STREAMFILE* sf, clHCA_stInfo* info) {
+    void* handle;
+    int ok;
+
+    handle = calloc(1, clHCA_sizeof());
+    if (!handle) return 0;
+
+    ok = decode_hca_header(handle, sf, info);
+
+    clHCA_done(handle);
+    free(handle);
+    return ok;
+}
+
 clHCA_stInfo* hca_get_info(hca_codec_data* data) {
     return &data->info;
 }
@@ -310,8 +338,20 @@ void test_hca_key(hca_codec_data* data, hca_keytest_t* hk) {
 }
 
 void hca_set_encryption_key(hca_codec_data* data, uint64_t keycode, uint64_t subkey) {
+    data->keycode = keycode;
+    data->subkey = subkey;
+
     if (subkey) {
         keycode = keycode * ( ((uint64_t)subkey << 16u) | ((uint16_t)~subkey + 2u) );
     }
     clHCA_SetKey(data->handle, (unsigned long long)keycode);
 }
+
+int hca_get_encryption_key(hca_codec_data* data, uint64_t* p_keycode, uint64_t* p_subkey) {
+    if (!data->info.encryptionEnabled)
+        return 0;
+
+    *p_keycode = data->keycode;
+    *p_subkey = data->subkey;
+    return 1;
+}
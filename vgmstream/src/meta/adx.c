@@ -85,16 +85,16 @@ VGMSTREAM* init_vgmstream_adx_subkey(STREAMFILE* sf, uint16_t subkey) {
     cutoff = read_u16be(0x10,sf); /* high-pass cutoff frequency, always 500 */
     version = read_u16be(0x12,sf); /* version + revision, originally read as separate */
 
-    /* encryption */
+    /* encryption (key is only needed to decode) */
     if (version == 0x0408) {
-        if (!find_adx_key(sf, 8, &xor_start, &xor_mult, &xor_add, 0)) {
+        if (!is_probe_streamfile_metadata_only(sf) && !find_adx_key(sf, 8, &xor_start, &xor_mult, &xor_add, 0)) {
             vgm_logi("ADX: decryption keystring not found\n");
         }
         coding_type = coding_CRI_ADX_enc_8;
         version = 0x0400;
     }
     else if (version == 0x0409) {
-        if (!find_adx_key(sf, 9, &xor_start, &xor_mult, &xor_add, subkey)) {
+        if (!is_probe_streamfile_metadata_only(sf) && !find_adx_key(sf, 9, &xor_start, &xor_mult, &xor_add, subkey)) {
             vgm_logi("ADX: decryption keycode not found\n");
         }
         coding_type = coding_CRI_ADX_enc_9;
@@ -323,6 +323,18 @@ static bool find_adx_key(STREAMFILE* sf, uint8_t type, uint16_t *xor_start, uint
         /* no key set or unknown format, try list */
     }
 
+    /* key resolved when the file was indexed (base/metaindex.c) */
+    {
+        uint8_t keybuf[0x06];
+
+        if (read_probe_streamfile_key(sf, keybuf, sizeof(keybuf)) == 0x06) {
+            *xor_start = get_u16be(keybuf + 0x00);
+            *xor_mult  = get_u16be(keybuf + 0x02);
+            *xor_add   = get_u16be(keybuf + 0x04);
+            return true;
+        }
+    }
+
     /* setup totals */
     {
         int frame_count;
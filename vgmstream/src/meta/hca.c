@@ -25,6 +25,7 @@ VGMSTREAM* init_vgmstream_hca_subkey(STREAMFILE* sf, uint16_t subkey) {
     VGMSTREAM* vgmstream = NULL;
     hca_codec_data* hca_data = NULL;
     clHCA_stInfo* hca_info;
+    clHCA_stInfo header_info;
 
 
     /* checks */
@@ -34,17 +35,24 @@ VGMSTREAM* init_vgmstream_hca_subkey(STREAMFILE* sf, uint16_t subkey) {
     if (!check_extensions(sf, "hca"))
         return NULL;
 
-    /* init vgmstream and library's context, will validate the HCA */
-    hca_data = init_hca(sf);
-    if (!hca_data) {
-        vgm_logi("HCA: unknown format (report)\n");
-        goto fail;
+    /* init vgmstream and library's context, will validate the HCA (probes only need the header) */
+    if (is_probe_streamfile_metadata_only(sf)) {
+        if (!read_hca_info(sf, &header_info))
+            goto fail;
+        hca_info = &header_info;
     }
+    else {
+        hca_data = init_hca(sf);
+        if (!hca_data) {
+            vgm_logi("HCA: unknown format (report)\n");
+            goto fail;
+        }
 
-    hca_info = hca_get_info(hca_data);
+        hca_info = hca_get_info(hca_data);
+    }
 
     /* find decryption key in external file or preloaded list */
-    if (hca_info->encryptionEnabled) {
+    if (hca_data && hca_info->encryptionEnabled) {
         uint64_t keycode = 0;
         uint8_t keybuf[20+1] = {0}; /* max keystring 20, +1 extra null */
         size_t key_size;
@@ -64,6 +72,10 @@ VGMSTREAM* init_vgmstream_hca_subkey(STREAMFILE* sf, uint16_t subkey) {
             keycode = get_u64be(keybuf+0x00);
             subkey  = get_u16be(keybuf+0x08);
         }
+        else if (read_probe_streamfile_key(sf, keybuf, sizeof(keybuf)) == 0x08+0x02) { /* resolved when indexed (base/metaindex.c) */
+            keycode = get_u64be(keybuf+0x00);
+            subkey  = get_u16be(keybuf+0x08);
+        }
 #ifdef HCA_BRUTEFORCE
         else if (1) {
             int ok = find_hca_key(hca_data, &keycode, subkey);
@@ -794,8 +794,10 @@ VGMSTREAM* init_vgmstream_riff(STREAMFILE* sf) {
         case coding_FFmpeg: {
             if (!fmt.is_at3 && !fmt.is_at3p) goto fail;
 
-            vgmstream->codec_data = init_ffmpeg_atrac3_riff(sf, 0x00, NULL);
-            if (!vgmstream->codec_data) goto fail;
+            if (!is_probe_streamfile_metadata_only(sf)) {
+                vgmstream->codec_data = init_ffmpeg_atrac3_riff(sf, 0x00, NULL);
+                if (!vgmstream->codec_data) goto fail;
+            }
 
             vgmstream->num_samples = fact_sample_count;
             if (loop_flag) {
@@ -90,8 +90,10 @@ VGMSTREAM* init_vgmstream_xwma(STREAMFILE* sf) {
      */
 #ifdef VGM_USE_FFMPEG
     {
-        vgmstream->codec_data = init_ffmpeg_xwma(sf, xwma.data_offset, xwma.data_size, xwma.format, xwma.channels, xwma.sample_rate, xwma.avg_bitrate, xwma.block_size);
-        if (!vgmstream->codec_data) goto fail;
+        if (!is_probe_streamfile_metadata_only(sf)) {
+            vgmstream->codec_data = init_ffmpeg_xwma(sf, xwma.data_offset, xwma.data_size, xwma.format, xwma.channels, xwma.sample_rate, xwma.avg_bitrate, xwma.block_size);
+            if (!vgmstream->codec_data) goto fail;
+        }
         vgmstream->coding_type = coding_FFmpeg;
         vgmstream->layout_type = layout_none;
 
@@ -985,6 +985,292 @@ STREAMFILE* open_multifile_streamfile_f(STREAMFILE** sfs, size_t sfs_size) {
 
 /* **************************************************** */
 
+/* file data pinned during a probe, shared by all probe SFs that open it */
+typedef struct probe_file_t {
+    char name[PATH_LIMIT];
+    int failed;             /* couldn't be opened, later opens fail right away */
+    size_t file_size;
+    uint8_t* head;          /* first bytes, read on first use */
+    size_t head_size;
+    uint8_t* tail;          /* last bytes, read on first use */
+    offv_t tail_offset;
+    size_t tail_size;
+    struct probe_file_t* next;
+} probe_file_t;
+
+typedef struct {
+    int refs;               /* probe SFs using this state */
+    int active;             /* pinned data is only used until the first probe SF is closed */
+    int flags;              /* PROBE_* */
+    size_t pin_size;
+    probe_file_t* files;
+    STREAMFILE* main_sf;
+    probe_file_t* main_file;
+    uint8_t key[0x10];      /* decryption key known in advance for the main file */
+    size_t key_size;
+} probe_state_t;
+
+typedef struct {
+    STREAMFILE vt;
+
+    STREAMFILE* inner_sf;
+    probe_state_t* state;
+    probe_file_t* file;
+    int root;               /* first SF, ends the probe on close */
+    int owns_inner;         /* inner_sf was opened through the probe */
+} PROBE_STREAMFILE;
+
+static STREAMFILE* open_probe_streamfile_internal(STREAMFILE* sf, probe_state_t* state, const char* filename, int root, int owns_inner);
+
+/* reads a pinned part once, returns NULL if it can't be used */
+static uint8_t* probe_pin(PROBE_STREAMFILE* sf, uint8_t** buf, offv_t offset, size_t* size) {
+    if (*buf)
+        return *buf;
+    if (*size == 0)
+        return NULL;
+
+    *buf = malloc(*size);
+    if (!*buf) {
+        *size = 0;
+        return NULL;
+    }
+
+    /* short reads only pin what could be read */
+    *size = sf->inner_sf->read(sf->inner_sf, *buf, offset, *size);
+    return *buf;
+}
+
+static size_t probe_read(PROBE_STREAMFILE* sf, uint8_t* dst, offv_t offset, size_t length) {
+    /* serve reads fully inside pinned parts (cut at EOF like regular reads) */
+    if (sf->state->active && dst && offset >= 0 && offset < (offv_t)sf->file->file_size) {
+        probe_file_t* file = sf->file;
+        offv_t end = offset + length;
+        if (end > (offv_t)file->file_size)
+            end = file->file_size;
+
+        if (end <= (offv_t)file->head_size && probe_pin(sf, &file->head, 0, &file->head_size) && end <= (offv_t)file->head_size) {
+            memcpy(dst, file->head + offset, end - offset);
+            return end - offset;
+        }
+        if (offset >= file->tail_offset && probe_pin(sf, &file->tail, file->tail_offset, &file->tail_size) && end <= file->tail_offset + (offv_t)file->tail_size) {
+            memcpy(dst, file->tail + (offset - file->tail_offset), end - offset);
+            return end - offset;
+        }
+    }
+
+    return sf->inner_sf->read(sf->inner_sf, dst, offset, length);
+}
+static size_t probe_get_size(PROBE_STREAMFILE* sf) {
+    if (sf->state->active)
+        return sf->file->file_size; /* cache */
+    return sf->inner_sf->get_size(sf->inner_sf);
+}
+static offv_t probe_get_offset(PROBE_STREAMFILE* sf) {
+    return sf->inner_sf->get_offset(sf->inner_sf); /* default */
+}
+static void probe_get_name(PROBE_STREAMFILE* sf, char* name, size_t name_size) {
+    sf->inner_sf->get_name(sf->inner_sf, name, name_size); /* default */
+}
+
+static probe_file_t* probe_find_file(probe_state_t* state, const char* filename) {
+    probe_file_t* file;
+    for (file = state->files; file; file = file->next) {
+        if (strcmp(file->name, filename) == 0)
+            return file;
+    }
+    return NULL;
+}
+
+/* adds a file, pinned parts are read when first needed */
+static probe_file_t* probe_add_file(probe_state_t* state, STREAMFILE* sf, const char* filename) {
+    probe_file_t* file = calloc(1, sizeof(probe_file_t));
+    if (!file) return NULL;
+
+    snprintf(file->name, sizeof(file->name), "%s", filename);
+
+    if (sf) {
+        file->file_size = sf->get_size(sf);
+        file->head_size = file->file_size < state->pin_size ? file->file_size : state->pin_size;
+        file->tail_size = file->file_size - file->head_size < state->pin_size ? file->file_size - file->head_size : state->pin_size;
+        file->tail_offset = file->file_size - file->tail_size;
+    }
+    else {
+        file->failed = 1;
+    }
+
+    file->next = state->files;
+    state->files = file;
+    return file;
+}
+
+static void probe_free_files(probe_state_t* state) {
+    while (state->files) {
+        probe_file_t* file = state->files;
+        state->files = file->next;
+        free(file->head);
+        free(file->tail);
+        free(file);
+    }
+}
+
+static STREAMFILE* probe_open(PROBE_STREAMFILE* sf, const char* const filename, size_t buf_size) {
+    STREAMFILE* new_inner_sf;
+    STREAMFILE* new_sf;
+
+    if (!sf->state->active || !filename)
+        return sf->inner_sf->open(sf->inner_sf, filename, buf_size); /* default */
+
+    /* metas often try the same missing companion files */
+    {
+        probe_file_t* file = probe_find_file(sf->state, filename);
+        if (file && file->failed)
+            return NULL;
+
+        /* channels only need to be opened to validate the file, no need for their own file handles and buffers */
+        if (file && file == sf->state->main_file && (sf->state->flags & PROBE_SHARE_REOPENS))
+            return open_probe_streamfile_internal(sf->state->main_sf, sf->state, filename, 0, 0);
+    }
+
+    new_inner_sf = sf->inner_sf->open(sf->inner_sf, filename, buf_size);
+    if (!new_inner_sf) {
+        probe_add_file(sf->state, NULL, filename);
+        return NULL;
+    }
+
+    new_sf = open_probe_streamfile_internal(new_inner_sf, sf->state, filename, 0, 1);
+    if (!new_sf)
+        return new_inner_sf; /* still usable */
+    return new_sf;
+}
+
+static void probe_close(PROBE_STREAMFILE* sf) {
+    probe_state_t* state = sf->state;
+
+    if (sf->root) {
+        /* SFs opened during the probe may live on (in a VGMSTREAM), but don't need pinned data anymore */
+        state->active = 0;
+        state->main_file = NULL;
+        probe_free_files(state);
+    }
+
+    if (sf->owns_inner) {
+        sf->inner_sf->close(sf->inner_sf);
+    }
+
+    state->refs--;
+    if (state->refs == 0) {
+        probe_free_files(state);
+        free(state);
+    }
+    free(sf);
+}
+
+static STREAMFILE* open_probe_streamfile_internal(STREAMFILE* sf, probe_state_t* state, const char* filename, int root, int owns_inner) {
+    PROBE_STREAMFILE* this_sf = NULL;
+
+    this_sf = calloc(1, sizeof(PROBE_STREAMFILE));
+    if (!this_sf) return NULL;
+
+    /* reopens of the same file share its pinned data */
+    this_sf->file = probe_find_file(state, filename);
+    if (!this_sf->file) {
+        this_sf->file = probe_add_file(state, sf, filename);
+        if (!this_sf->file) goto fail;
+    }
+
+    /* set callbacks and internals */
+    this_sf->vt.read = (void*)probe_read;
+    this_sf->vt.get_size = (void*)probe_get_size;
+    this_sf->vt.get_offset = (void*)probe_get_offset;
+    this_sf->vt.get_name = (void*)probe_get_name;
+    this_sf->vt.open = (void*)probe_open;
+    this_sf->vt.close = (void*)probe_close;
+    this_sf->vt.stream_index = sf->stream_index;
+
+    this_sf->inner_sf = sf;
+    this_sf->state = state;
+    this_sf->root = root;
+    this_sf->owns_inner = owns_inner;
+    state->refs++;
+
+    return &this_sf->vt;
+fail:
+    free(this_sf);
+    return NULL;
+}
+
+STREAMFILE* open_probe_streamfile(STREAMFILE* sf, size_t pin_size, int flags) {
+    char filename[PATH_LIMIT];
+    probe_state_t* state = NULL;
+    STREAMFILE* new_sf = NULL;
+
+    if (!sf) return NULL;
+
+    if (pin_size == 0)
+        pin_size = STREAMFILE_DEFAULT_BUFFER_SIZE;
+
+    state = calloc(1, sizeof(probe_state_t));
+    if (!state) return NULL;
+
+    state->active = 1;
+    state->flags = flags;
+    state->pin_size = pin_size;
+
+    sf->get_name(sf, filename, sizeof(filename));
+    new_sf = open_probe_streamfile_internal(sf, state, filename, 1, 0);
+    if (!new_sf) {
+        probe_free_files(state);
+        free(state);
+        return NULL;
+    }
+
+    state->main_sf = sf;
+    state->main_file = ((PROBE_STREAMFILE*)new_sf)->file;
+
+    return new_sf;
+}
+
+/* returns the probe SF of the main file, or NULL if sf isn't one */
+static PROBE_STREAMFILE* probe_get_main(STREAMFILE* sf) {
+    PROBE_STREAMFILE* probe_sf = (PROBE_STREAMFILE*)sf;
+
+    if (!sf || (void*)sf->read != (void*)probe_read)
+        return NULL;
+    if (!probe_sf->state->active || probe_sf->file != probe_sf->state->main_file)
+        return NULL;
+    return probe_sf;
+}
+
+void set_probe_streamfile_key(STREAMFILE* sf, const uint8_t* key, size_t key_size) {
+    PROBE_STREAMFILE* probe_sf = probe_get_main(sf);
+    if (!probe_sf) return;
+
+    if (!key || key_size > sizeof(probe_sf->state->key))
+        key_size = 0;
+    if (key_size)
+        memcpy(probe_sf->state->key, key, key_size);
+    probe_sf->state->key_size = key_size;
+}
+
+int is_probe_streamfile_metadata_only(STREAMFILE* sf) {
+    PROBE_STREAMFILE* probe_sf = (PROBE_STREAMFILE*)sf;
+
+    if (!sf || (void*)sf->read != (void*)probe_read)
+        return 0;
+    return probe_sf->state->active && (probe_sf->state->flags & PROBE_METADATA_ONLY);
+}
+
+size_t read_probe_streamfile_key(STREAMFILE* sf, uint8_t* buf, size_t buf_size) {
+    PROBE_STREAMFILE* probe_sf = probe_get_main(sf);
+    if (!probe_sf || probe_sf->state->key_size == 0 || probe_sf->state->key_size > buf_size)
+        return 0;
+
+    memcpy(buf, probe_sf->state->key, probe_sf->state->key_size);
+    return probe_sf->state->key_size;
+}
+
+/* **************************************************** */
+
 STREAMFILE* open_streamfile(STREAMFILE* sf, const char* pathname) {
     return sf->open(sf, pathname, STREAMFILE_DEFAULT_BUFFER_SIZE);
 }
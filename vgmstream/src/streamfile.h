@@ -126,6 +126,27 @@ STREAMFILE* open_fakename_streamfile_f(STREAMFILE* sf, const char* fakename, con
 STREAMFILE* open_multifile_streamfile(STREAMFILE** sfs, size_t sfs_size);
 STREAMFILE* open_multifile_streamfile_f(STREAMFILE** sfs, size_t sfs_size);
 
+/* flags for open_probe_streamfile */
+#define PROBE_SHARE_REOPENS 0x01    /* reopens of the file share the underlying streamfile instead of opening it again,
+                                     * so anything opened through it must be closed before it */
+#define PROBE_METADATA_ONLY 0x02    /* metas may skip decoder setup and key searches, the VGMSTREAM can't be played */
+
+/* Opens a STREAMFILE that keeps the first and last pin_size bytes of the file in memory, as well as of files
+ * opened through it (which are probe SFs too), and fails right away on files that couldn't be opened before.
+ * Meant for format detection, where metas re-read the same headers and try the same companion files.
+ * Doesn't close the underlying streamfile. Closing it ends the probe: files opened through it stay valid
+ * but read directly from then on. Pin size is optional, flags are PROBE_* values. */
+STREAMFILE* open_probe_streamfile(STREAMFILE* sf, size_t pin_size, int flags);
+
+/* Returns 1 if sf is a probe SF opened with PROBE_METADATA_ONLY and the probe is still going on. Metas check it
+ * before allocating codec data or searching keys, and only fill the header values (samples, loops, channels...). */
+int is_probe_streamfile_metadata_only(STREAMFILE* sf);
+
+/* Sets a decryption key already known for the probed file (format depends on the codec), that metas may read
+ * with read_probe_streamfile_key instead of searching it. Read returns 0 if sf isn't the probed file or has no key. */
+void set_probe_streamfile_key(STREAMFILE* sf, const uint8_t* key, size_t key_size);
+size_t read_probe_streamfile_key(STREAMFILE* sf, uint8_t* buf, size_t buf_size);
+
 /* Opens a STREAMFILE from a (path)+filename.
  * Just a wrapper, to avoid having to access the STREAMFILE's callbacks directly. */
 STREAMFILE* open_streamfile(STREAMFILE* sf, const char* pathname);
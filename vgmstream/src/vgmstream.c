@@ -12,10 +12,11 @@
 #include "base/decode.h"
 #include "base/render.h"
 #include "base/mixing.h"
+#include "base/detect.h"
+#include "base/metaindex.h"
+#include "base/seektable.h"
 #include "util/sf_utils.h"
 
-typedef VGMSTREAM* (*init_vgmstream_t)(STREAMFILE*);
-
 static void try_dual_file_stereo(VGMSTREAM* opened_vgmstream, STREAMFILE* sf, init_vgmstream_t init_vgmstream_function);
 
 /* list of metadata parser functions that will recognize files, used on init */
@@ -580,107 +581,168 @@ static const int init_vgmstream_count = LOCAL_ARRAY_LENGTH(init_vgmstream_functi
 /* INIT/META                                                                 */
 /*****************************************************************************/
 
-/* internal version with all parameters */
-static VGMSTREAM* init_vgmstream_internal(STREAMFILE* sf) {
-    if (!sf)
+/* calls one init function and checks the result, returns NULL if the format didn't accept the file */
+static VGMSTREAM* init_vgmstream_format(STREAMFILE* sf, init_vgmstream_t init_vgmstream_function) {
+    /* call init function and see if valid VGMSTREAM was returned */
+    VGMSTREAM* vgmstream = init_vgmstream_function(sf);
+    if (!vgmstream)
         return NULL;
 
-    /* try a series of formats, see which works */
-    for (int i = 0; i < init_vgmstream_count; i++) {
-        init_vgmstream_t init_vgmstream_function = init_vgmstream_functions[i];
-    
-
-        /* call init function and see if valid VGMSTREAM was returned */
-        VGMSTREAM* vgmstream = init_vgmstream_function(sf);
-        if (!vgmstream)
-            continue;
-
-        /* fail if there is nothing/too much to play (<=0 generates empty files, >N writes GBs of garbage) */
-        if (vgmstream->num_samples <= 0 || vgmstream->num_samples > VGMSTREAM_MAX_NUM_SAMPLES) {
-            VGM_LOG("VGMSTREAM: wrong num_samples %i\n", vgmstream->num_samples);
-            close_vgmstream(vgmstream);
-            continue;
-        }
+    /* fail if there is nothing/too much to play (<=0 generates empty files, >N writes GBs of garbage) */
+    if (vgmstream->num_samples <= 0 || vgmstream->num_samples > VGMSTREAM_MAX_NUM_SAMPLES) {
+        VGM_LOG("VGMSTREAM: wrong num_samples %i\n", vgmstream->num_samples);
+        close_vgmstream(vgmstream);
+        return NULL;
+    }
 
-        /* everything should have a reasonable sample rate */
-        if (vgmstream->sample_rate < VGMSTREAM_MIN_SAMPLE_RATE || vgmstream->sample_rate > VGMSTREAM_MAX_SAMPLE_RATE) {
-            VGM_LOG("VGMSTREAM: wrong sample_rate %i\n", vgmstream->sample_rate);
-            close_vgmstream(vgmstream);
-            continue;
-        }
+    /* everything should have a reasonable sample rate */
+    if (vgmstream->sample_rate < VGMSTREAM_MIN_SAMPLE_RATE || vgmstream->sample_rate > VGMSTREAM_MAX_SAMPLE_RATE) {
+        VGM_LOG("VGMSTREAM: wrong sample_rate %i\n", vgmstream->sample_rate);
+        close_vgmstream(vgmstream);
+        return NULL;
+    }
 
-        /* sanify loops and remove bad metadata */
-        if (vgmstream->loop_flag) {
-            if (vgmstream->loop_end_sample <= vgmstream->loop_start_sample
-                    || vgmstream->loop_end_sample > vgmstream->num_samples
-                    || vgmstream->loop_start_sample < 0) {
-                VGM_LOG("VGMSTREAM: wrong loops ignored (lss=%i, lse=%i, ns=%i)\n",
-                        vgmstream->loop_start_sample, vgmstream->loop_end_sample, vgmstream->num_samples);
-                vgmstream->loop_flag = 0;
-                vgmstream->loop_start_sample = 0;
-                vgmstream->loop_end_sample = 0;
-            }
+    /* sanify loops and remove bad metadata */
+    if (vgmstream->loop_flag) {
+        if (vgmstream->loop_end_sample <= vgmstream->loop_start_sample
+                || vgmstream->loop_end_sample > vgmstream->num_samples
+                || vgmstream->loop_start_sample < 0) {
+            VGM_LOG("VGMSTREAM: wrong loops ignored (lss=%i, lse=%i, ns=%i)\n",
+                    vgmstream->loop_start_sample, vgmstream->loop_end_sample, vgmstream->num_samples);
+            vgmstream->loop_flag = 0;
+            vgmstream->loop_start_sample = 0;
+            vgmstream->loop_end_sample = 0;
         }
+    }
 
-        /* test if candidate for dual stereo */
-        if (vgmstream->channels == 1 && vgmstream->allow_dual_stereo == 1) {
-            try_dual_file_stereo(vgmstream, sf, init_vgmstream_function);
-        }
+    /* test if candidate for dual stereo */
+    if (vgmstream->channels == 1 && vgmstream->allow_dual_stereo == 1) {
+        try_dual_file_stereo(vgmstream, sf, init_vgmstream_function);
+    }
 
 
 #ifdef VGM_USE_FFMPEG
-        /* check FFmpeg streams here, for lack of a better place */
-        if (vgmstream->coding_type == coding_FFmpeg) {
-            int ffmpeg_subsongs = ffmpeg_get_subsong_count(vgmstream->codec_data);
-            if (ffmpeg_subsongs && !vgmstream->num_streams) {
-                vgmstream->num_streams = ffmpeg_subsongs;
-            }
+    /* check FFmpeg streams here, for lack of a better place */
+    if (vgmstream->coding_type == coding_FFmpeg) {
+        int ffmpeg_subsongs = ffmpeg_get_subsong_count(vgmstream->codec_data);
+        if (ffmpeg_subsongs && !vgmstream->num_streams) {
+            vgmstream->num_streams = ffmpeg_subsongs;
         }
+    }
 #endif
 
-        /* some players are picky with incorrect channel layouts */
-        if (vgmstream->channel_layout > 0) {
-            int output_channels = vgmstream->channels;
-            int ch, count = 0, max_ch = 32;
-            for (ch = 0; ch < max_ch; ch++) {
-                int bit = (vgmstream->channel_layout >> ch) & 1;
-                if (ch > 17 && bit) {
-                    VGM_LOG("VGMSTREAM: wrong bit %i in channel_layout %x\n", ch, vgmstream->channel_layout);
-                    vgmstream->channel_layout = 0;
-                    break;
-                }
-                count += bit;
-            }
-
-            if (count > output_channels) {
-                VGM_LOG("VGMSTREAM: wrong totals %i in channel_layout %x\n", count, vgmstream->channel_layout);
+    /* some players are picky with incorrect channel layouts */
+    if (vgmstream->channel_layout > 0) {
+        int output_channels = vgmstream->channels;
+        int ch, count = 0, max_ch = 32;
+        for (ch = 0; ch < max_ch; ch++) {
+            int bit = (vgmstream->channel_layout >> ch) & 1;
+            if (ch > 17 && bit) {
+                VGM_LOG("VGMSTREAM: wrong bit %i in channel_layout %x\n", ch, vgmstream->channel_layout);
                 vgmstream->channel_layout = 0;
+                break;
             }
+            count += bit;
         }
 
-        /* files can have thousands subsongs, but let's put a limit */
-        if (vgmstream->num_streams < 0 || vgmstream->num_streams > VGMSTREAM_MAX_SUBSONGS) {
-            VGM_LOG("VGMSTREAM: wrong num_streams (ns=%i)\n", vgmstream->num_streams);
-            close_vgmstream(vgmstream);
-            continue;
+        if (count > output_channels) {
+            VGM_LOG("VGMSTREAM: wrong totals %i in channel_layout %x\n", count, vgmstream->channel_layout);
+            vgmstream->channel_layout = 0;
         }
+    }
 
-        /* save info */
-        /* stream_index 0 may be used by plugins to signal "vgmstream default" (IOW don't force to 1) */
-        if (vgmstream->stream_index == 0) {
-            vgmstream->stream_index = sf->stream_index;
-        }
+    /* files can have thousands subsongs, but let's put a limit */
+    if (vgmstream->num_streams < 0 || vgmstream->num_streams > VGMSTREAM_MAX_SUBSONGS) {
+        VGM_LOG("VGMSTREAM: wrong num_streams (ns=%i)\n", vgmstream->num_streams);
+        close_vgmstream(vgmstream);
+        return NULL;
+    }
+
+    /* save info */
+    /* stream_index 0 may be used by plugins to signal "vgmstream default" (IOW don't force to 1) */
+    if (vgmstream->stream_index == 0) {
+        vgmstream->stream_index = sf->stream_index;
+    }
+
+
+    setup_vgmstream(vgmstream); /* final setup */
 
+    return vgmstream;
+}
 
-        setup_vgmstream(vgmstream); /* final setup */
+/* tries all formats that may accept the file, and sets which one did (position in the table) */
+static VGMSTREAM* init_vgmstream_detect(STREAMFILE* sf, int* p_format) {
+    int candidates[LOCAL_ARRAY_LENGTH(init_vgmstream_functions)];
+    int candidate_count;
+
+    /* try formats that may accept the file (in table order), see which works */
+    candidate_count = detect_vgmstream_candidates(sf, init_vgmstream_functions, init_vgmstream_count, candidates);
+    for (int i = 0; i < candidate_count; i++) {
+        VGMSTREAM* vgmstream = init_vgmstream_format(sf, init_vgmstream_functions[candidates[i]]);
+        if (vgmstream) {
+            if (p_format) *p_format = candidates[i];
+            return vgmstream;
+        }
+    }
 
-        return vgmstream;
+    /* no index: try the whole series of formats */
+    if (candidate_count < 0) {
+        for (int i = 0; i < init_vgmstream_count; i++) {
+            VGMSTREAM* vgmstream = init_vgmstream_format(sf, init_vgmstream_functions[i]);
+            if (vgmstream) {
+                if (p_format) *p_format = i;
+                return vgmstream;
+            }
+        }
     }
 
     /* not supported */
     return NULL;
 }
 
+/* opens the format the metadata index remembers for this file (sf must be a probe), NULL if unknown or outdated */
+static VGMSTREAM* init_vgmstream_indexed(STREAMFILE* sf) {
+    const metaindex_entry_t* entry;
+    VGMSTREAM* vgmstream;
+
+    entry = metaindex_find(metaindex_get_active(), sf, init_vgmstream_count);
+    if (!entry)
+        return NULL;
+
+    /* known key skips the search (the probe only gives it to the file itself, not to subfiles) */
+    set_probe_streamfile_key(sf, entry->key, entry->key_size);
+    vgmstream = init_vgmstream_format(sf, init_vgmstream_functions[entry->format]);
+    set_probe_streamfile_key(sf, NULL, 0);
+
+    if (vgmstream && !metaindex_check(entry, vgmstream)) {
+        VGM_LOG("VGMSTREAM: outdated index entry for %s\n", entry->name);
+        close_vgmstream(vgmstream);
+        return NULL;
+    }
+
+    return vgmstream;
+}
+
+/* internal version with all parameters */
+static VGMSTREAM* init_vgmstream_internal(STREAMFILE* sf) {
+    STREAMFILE* sf_probe;
+    VGMSTREAM* vgmstream;
+
+    if (!sf)
+        return NULL;
+
+    /* metas re-read the same headers and companion files, keep them in memory while formats are tried */
+    sf_probe = open_probe_streamfile(sf, 0, 0);
+    if (!sf_probe)
+        return init_vgmstream_detect(sf, NULL);
+
+    vgmstream = init_vgmstream_indexed(sf_probe);
+    if (!vgmstream)
+        vgmstream = init_vgmstream_detect(sf_probe, NULL);
+    close_streamfile(sf_probe);
+    return vgmstream;
+}
+
 void setup_vgmstream(VGMSTREAM* vgmstream) {
 
     //TODO improve cleanup (done here to handle manually added layers)
@@ -729,11 +791,77 @@ VGMSTREAM* init_vgmstream_from_STREAMFILE(STREAMFILE* sf) {
     return init_vgmstream_internal(sf);
 }
 
+int probe_vgmstream_from_STREAMFILE(STREAMFILE* sf, vgmstream_probe_info* info) {
+    STREAMFILE* sf_probe;
+    VGMSTREAM* vgmstream;
+
+    if (!sf || !info)
+        return 0;
+
+    /* same detection, but channels don't open the file again (the VGMSTREAM is closed before the probe)
+     * and metas skip decoder setup, only header values are needed */
+    sf_probe = open_probe_streamfile(sf, 0, PROBE_SHARE_REOPENS | PROBE_METADATA_ONLY);
+    if (!sf_probe)
+        return 0;
+
+    vgmstream = init_vgmstream_indexed(sf_probe);
+    if (!vgmstream)
+        vgmstream = init_vgmstream_detect(sf_probe, NULL);
+    if (vgmstream) {
+        info->sample_rate = vgmstream->sample_rate;
+        info->channels = vgmstream->channels;
+        info->num_samples = vgmstream->num_samples;
+        info->loop_flag = vgmstream->loop_flag;
+        info->loop_start_sample = vgmstream->loop_start_sample;
+        info->loop_end_sample = vgmstream->loop_end_sample;
+        info->num_streams = vgmstream->num_streams;
+        close_vgmstream(vgmstream);
+    }
+
+    close_streamfile(sf_probe);
+    return vgmstream != NULL;
+}
+
+int vgmstream_index_update(vgmstream_index_t* index, STREAMFILE* sf, vgmstream_index_t* old_index) {
+    STREAMFILE* sf_probe;
+    const metaindex_entry_t* entry;
+    VGMSTREAM* vgmstream;
+    int format = 0, res = 0;
+
+    if (!index || !sf)
+        return 0;
+
+    /* full init though, the index saves resolved keys */
+    sf_probe = open_probe_streamfile(sf, 0, PROBE_SHARE_REOPENS);
+    if (!sf_probe)
+        return 0;
+
+    entry = metaindex_find(old_index, sf_probe, init_vgmstream_count);
+    if (entry) {
+        if (metaindex_add_entry(index, entry, init_vgmstream_count))
+            res = 2;
+    }
+    else {
+        vgmstream = init_vgmstream_detect(sf_probe, &format);
+        if (vgmstream) {
+            if (metaindex_add(index, sf_probe, format, vgmstream, init_vgmstream_count))
+                res = 1;
+            close_vgmstream(vgmstream);
+        }
+    }
+
+    close_streamfile(sf_probe);
+    return res;
+}
+
 /* Reset a VGMSTREAM to its state at the start of playback (when a plugin seeks back to zero). */
 void reset_vgmstream(VGMSTREAM* vgmstream) {
 
+    void* seek_data = vgmstream->seek_data; /* saved points stay valid */
+
     /* reset the VGMSTREAM and channels back to their original state */
     memcpy(vgmstream, vgmstream->start_vgmstream, sizeof(VGMSTREAM));
+    vgmstream->seek_data = seek_data;
     memcpy(vgmstream->ch, vgmstream->start_ch, sizeof(VGMSTREAMCHANNEL)*vgmstream->channels);
     /* loop_ch is not reset here because there is a possibility of the
      * init_vgmstream_* function doing something tricky and precomputing it.
@@ -852,6 +980,7 @@ void close_vgmstream(VGMSTREAM* vgmstream) {
     }
 
     mixing_close(vgmstream);
+    seektable_free(vgmstream);
     free(vgmstream->tmpbuf);
     free(vgmstream->ch);
     free(vgmstream->start_ch);
@@ -241,6 +241,8 @@ typedef struct {
     /* Same, for special layouts. layout_data + codec_data may exist at the same time. */
     void* layout_data;
 
+    void* seek_data;                /* decoder state saved while decoding, for faster seeks (see seektable.c) */
+
 
     /* play config/state */
     int config_enabled;             /* config can be used */
@@ -328,6 +330,17 @@ typedef struct {
     } stream_info;
 } vgmstream_info;
 
+// Basic info from probe_vgmstream_from_STREAMFILE
+typedef struct {
+    int sample_rate;
+    int channels;
+    int32_t num_samples;
+    int loop_flag;
+    int32_t loop_start_sample;
+    int32_t loop_end_sample;
+    int num_streams;                /* subsongs, 0 if the format has none */
+} vgmstream_probe_info;
+
 /* -------------------------------------------------------------------------*/
 /* vgmstream "public" API                                                   */
 /* -------------------------------------------------------------------------*/
@@ -338,6 +351,33 @@ VGMSTREAM* init_vgmstream(const char* const filename);
 /* init with custom IO via streamfile */
 VGMSTREAM* init_vgmstream_from_STREAMFILE(STREAMFILE* sf);
 
+/* Same format detection, but only fills info (as init_vgmstream_from_STREAMFILE would) and closes the VGMSTREAM.
+ * Channels don't open their own streamfiles, cheaper for indexing many files. Returns 0 if not supported. */
+int probe_vgmstream_from_STREAMFILE(STREAMFILE* sf, vgmstream_probe_info* info);
+
+/* Metadata index: remembers which format accepted each file (plus its basic info and resolved decryption key),
+ * so init_vgmstream can open known files without trying every format or searching keys again.
+ * Files are matched by name (without path), size and a hash of their first and last bytes. */
+typedef struct vgmstream_index_t vgmstream_index_t;
+
+/* Creates an empty index, or loads one made by vgmstream_index_write. Load returns NULL if the data is invalid. */
+vgmstream_index_t* vgmstream_index_init(void);
+vgmstream_index_t* vgmstream_index_load(STREAMFILE* sf);
+
+/* Detects sf and adds it to the index. Unchanged files found in old_index (may be NULL) are copied without detection.
+ * Returns 1 if detected, 2 if copied from old_index, 0 if not supported. */
+int vgmstream_index_update(vgmstream_index_t* index, STREAMFILE* sf, vgmstream_index_t* old_index);
+
+/* Writes the index to buf if it fits, and returns the needed size (pass NULL to only get it). */
+size_t vgmstream_index_write(vgmstream_index_t* index, uint8_t* buf, size_t buf_size);
+
+/* Makes init_vgmstream use the index (NULL to stop). It isn't locked: set it before opening files, or make sure
+ * no other thread is opening a file while it's set or the index it replaced is closed (opens read it throughout). */
+void vgmstream_index_set(vgmstream_index_t* index);
+
+/* Also unsets it if active, with the same caveat. */
+void vgmstream_index_close(vgmstream_index_t* index);
+
 /* reset a VGMSTREAM to start of stream */
 void reset_vgmstream(VGMSTREAM* vgmstream);
 
@@ -350,6 +390,9 @@ int32_t get_vgmstream_play_samples(double looptimes, double fadeseconds, double
 /* Decode data into sample buffer. Returns < sample_count on stream end */
 int render_vgmstream(sample_t* buffer, int32_t sample_count, VGMSTREAM* vgmstream);
 
+/* Same as render_vgmstream but outputs float samples in the -1.0..1.0 range (mixing and fades are applied in float) */
+int render_vgmstream_f32(float* buffer, int32_t sample_count, VGMSTREAM* vgmstream);
+
 /* Seek to sample position (next render starts from that point). Use only after config is set (vgmstream_apply_config) */
 void seek_vgmstream(VGMSTREAM* vgmstream, int32_t seek_sample);
 